@@ -0,0 +1,80 @@
+#!/bin/bash -e
+#
+# Compares builtins of common_commands with external tools.
+#
+# Check bench/lib.sh for the environment variables and the CSV format.
+# PATH_DEPTHS sets the numbers of components of paths passed to realpath, default to "1 8 32".
+# NLEAVES sets the numbers of dirs created by one call to 'mkdir -p', default to 100.
+# NENTRIES sets the numbers of entries in the dir read by listdir, default to 10000.
+
+source "$(dirname "$0")/lib.sh"
+
+# Must be resolved before the builtins are loaded.
+external_realpath=$(type -P realpath)
+external_mkdir=$(type -P mkdir)
+
+bench_load common_commands
+
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+
+realpath_external() {
+    resolved=$("$external_realpath" "$path")
+}
+
+# Every iteration creates a new dir.
+cnt=0
+mkdir_builtin() {
+    mkdir "$scratch/mkdir/$(( cnt++ ))"
+}
+mkdir_external() {
+    "$external_mkdir" "$scratch/mkdir/$(( cnt++ ))"
+}
+
+# Every iteration creates NLEAVES dirs sharing the same new parent.
+leaves=( $(seq "${NLEAVES:-100}") )
+mkdir_batch_builtin() {
+    mkdir -p "${leaves[@]/#/$scratch/mkdir/$(( cnt++ ))/a/b/c/}"
+}
+mkdir_batch_external() {
+    "$external_mkdir" -p "${leaves[@]/#/$scratch/mkdir/$(( cnt++ ))/a/b/c/}"
+}
+
+walk_external() {
+    paths=$(find "$scratch")
+}
+
+list_glob() {
+    names=( "$scratch/listdir/"* )
+}
+
+bench_header
+
+for depth in ${PATH_DEPTHS:-1 8 32}; do
+    path=$scratch
+    for (( i = 0; i < depth; ++i )); do
+        path+=/$i
+    done
+    "$external_mkdir" -p "$path"
+    # Add a component to be removed by realpath
+    path+=/../$(( depth - 1 ))
+
+    bench_run "realpath $depth" realpath "$path" resolved
+    bench_run "$external_realpath $depth" realpath_external
+done
+
+"$external_mkdir" "$scratch/mkdir"
+bench_run "mkdir" mkdir_builtin
+bench_run "$external_mkdir" mkdir_external
+bench_run "mkdir -p ${#leaves[@]}" mkdir_batch_builtin
+bench_run "$external_mkdir -p ${#leaves[@]}" mkdir_batch_external
+
+"$external_mkdir" "$scratch/listdir"
+touch $(seq -f "$scratch/listdir/%g" "${NENTRIES:-10000}")
+bench_run "listdir ${NENTRIES:-10000}" listdir "$scratch/listdir" names
+bench_run "listdir -s ${NENTRIES:-10000}" listdir -s "$scratch/listdir" names
+bench_run "glob ${NENTRIES:-10000}" list_glob
+
+# Walks everything created above
+bench_run "walk" walk "$scratch" paths
+bench_run "find" walk_external
@@ -0,0 +1,70 @@
+# Helpers shared by the benchmarks in bench/, to be sourced by them.
+#
+# Environment variables:
+#  - LOADABLES_DIR: dir containing the built loadables, default to the root of this repo.
+#  - ITERATIONS: number of iterations of each benchmark, default to 1000.
+#
+# bench_run prints one line of CSV per benchmark, with the header printed by bench_header.
+
+# The decimal point of EPOCHREALTIME depends on the locale.
+export LC_ALL=C
+
+bench_prefix=$(realpath $(dirname "${BASH_SOURCE[0]}"))
+loadables_dir=${LOADABLES_DIR:-"${bench_prefix}/.."}
+iterations=${ITERATIONS:-1000}
+
+# Syscalls that benchmarked workloads never make, used to populate seccomp filters.
+cold_syscalls=acct,add_key,adjtimex,bpf,chroot,clock_adjtime,create_module,delete_module
+cold_syscalls+=,finit_module,get_kernel_syms,get_mempolicy,init_module,ioperm,iopl,kcmp
+cold_syscalls+=,kexec_file_load,kexec_load,keyctl,lookup_dcookie,mbind,move_pages,nfsservctl
+cold_syscalls+=,open_by_handle_at,perf_event_open,personality,pivot_root,process_vm_readv
+cold_syscalls+=,process_vm_writev,ptrace,query_module,quotactl,reboot,request_key,set_mempolicy
+cold_syscalls+=,setns,settimeofday,swapoff,swapon,sysfs,umount2,unshare,uselib,userfaultfd
+cold_syscalls+=,ustat,vhangup,vm86,vm86old
+
+# Usage: bench_load loadable...
+bench_load() {
+    local loadable
+    for loadable in "$@"; do
+        enable -f "${loadables_dir}/${loadable}" "$loadable"
+        "$loadable"
+    done
+}
+
+# Re-executes the script as root of a new user namespace if it is run unprivileged and
+# 'unshare -Ur' is permitted, so that namespace and mount benchmarks can run.
+#
+# Usage: bench_reexec_in_userns "$@"
+bench_reexec_in_userns() {
+    if [ "$EUID" -ne 0 ] && [ -z "$BENCH_IN_USERNS" ] && unshare -Ur true 2>/dev/null; then
+        export BENCH_IN_USERNS=1
+        exec unshare -Ur "$BASH" "$0" "$@"
+    fi
+}
+
+bench_header() {
+    echo "name,iterations,p50_usec,p99_usec,mean_usec"
+}
+
+# Runs cmd... $iterations times in the current shell and prints the percentiles of its latency.
+#
+# Usage: bench_run name cmd...
+bench_run() {
+    local name=$1
+    shift
+
+    local -a samples
+    local start end i total=0
+    for (( i = 0; i < iterations; ++i )); do
+        start=$EPOCHREALTIME
+        "$@"
+        end=$EPOCHREALTIME
+        samples[i]=$(( ${end/./} - ${start/./} ))
+        (( total += samples[i] ))
+    done
+
+    mapfile -t samples < <(printf '%s\n' "${samples[@]}" | sort -n)
+
+    local n=${#samples[@]}
+    echo "$name,$n,${samples[n * 50 / 100]},${samples[n * 99 / 100]},$(( total / n ))"
+}
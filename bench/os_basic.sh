@@ -0,0 +1,64 @@
+#!/bin/bash -e
+#
+# Compares builtins of os_basic with equivalent shell constructs and external tools.
+#
+# Check bench/lib.sh for the environment variables and the CSV format.
+# PAYLOAD_SIZES sets the sizes of messages in bytes, default to "16 4096 65536".
+# NFDS sets the numbers of fds passed by sendfds, default to "1 8 64 253".
+# ARGCS sets the numbers of args passed to fdecho, default to "10 100 1000 10000", which shows
+# the cost of the scratch buffers allocated per invocation.
+
+source "$(dirname "$0")/lib.sh"
+
+# Must be resolved before the builtin sleep is loaded.
+external_sleep=$(type -P sleep)
+
+bench_load os_basic
+
+exec {null}>/dev/null
+
+printf_fd() {
+    printf '%s\n' "$msg" >&$null
+}
+
+sendfds_round_trip() {
+    sendfds $sock1 "${fds[@]}"
+    recvfds $sock2 ${#fds[@]} received
+
+    local fd
+    for fd in "${received[@]}"; do
+        exec {fd}>&-
+    done
+}
+
+bench_header
+
+for size in ${PAYLOAD_SIZES:-16 4096 65536}; do
+    printf -v msg '%*s' $size ''
+
+    bench_run "fdputs $size" fdputs $null "$msg"
+    bench_run "fdecho $size" fdecho $null "$msg"
+    bench_run "printf >& $size" printf_fd
+done
+
+for argc in ${ARGCS:-10 100 1000 10000}; do
+    args=()
+    for (( i = 0; i < argc; ++i )); do
+        args+=( x )
+    done
+
+    bench_run "fdecho argc=$argc" fdecho $null "${args[@]}"
+done
+
+bench_run "sleep 0" sleep 0 0
+bench_run "$external_sleep 0" "$external_sleep" 0
+
+create_unixsocketpair stream sock1 sock2
+for nfd in ${NFDS:-1 8 64 253}; do
+    fds=()
+    for (( i = 0; i < nfd; ++i )); do
+        fds+=( $null )
+    done
+
+    bench_run "sendfds+recvfds $nfd" sendfds_round_trip
+done
@@ -0,0 +1,119 @@
+#!/bin/bash -e
+#
+# Measures the latency of each step of launching a sandbox, so that it can be compared
+# with the latency of the job run inside.
+#
+# Check bench/lib.sh for the environment variables and the CSV format.
+# MOUNT_PATHS sets the numbers of paths passed to make_accessible_under, default to "1 8 64".
+#
+# If run unprivileged, the benchmarks are run as root of a new user namespace if possible,
+# otherwise those requiring privilege are skipped.
+
+source "$(dirname "$0")/lib.sh"
+
+bench_reexec_in_userns "$@"
+bench_load sandboxing
+
+if [ "$EUID" -eq 0 ]; then
+    privileged=1
+else
+    echo "Not privileged, skip benchmarks for mount and capng" >&2
+fi
+
+clone_ns_exit() {
+    clone_ns -V "$@" pid
+    if [ "$pid" -eq 0 ]; then
+        exit 0
+    fi
+}
+
+subshell() {
+    ( : )
+}
+
+seccomp_build() {
+    seccomp_init ALLOW
+    seccomp_rule_add ERRNO:EPERM "$cold_syscalls"
+}
+seccomp_build_load() {
+    (
+        seccomp_build
+        seccomp_load
+    )
+}
+
+# Runs the benchmark in a private mount namespace with private /tmp, which is needed by
+# make_inaccessible and make_accessible_under, and starts with no mount stacked by the
+# previous benchmark.
+#
+# setup is called with $scratch, a new dir in the private /tmp, set.
+#
+# Usage: bench_run_in_mount_ns name setup cmd...
+bench_run_in_mount_ns() {
+    (
+        unshare_ns -M
+        mount --make-rprivate /
+        mount_pseudo tmpfs /tmp
+
+        scratch=$(mktemp -d)
+        "$2"
+        bench_run "$1" "${@:3}"
+    )
+}
+
+bench_header
+
+# Baseline of benchmarks that run in a subshell
+bench_run subshell subshell
+
+namespaces=( "" -C -I -N -M -p -U )
+for flags in "${namespaces[@]}"; do
+    bench_run "clone_ns -u${flags#-}" clone_ns_exit "-u${flags#-}"
+    if [ -n "$privileged" ] && [ -n "$flags" ]; then
+        bench_run "clone_ns $flags" clone_ns_exit $flags
+    fi
+done
+
+bench_run seccomp_build seccomp_build
+bench_run seccomp_build_load seccomp_build_load
+
+if [ -z "$privileged" ]; then
+    exit 0
+fi
+
+(
+    capng_fill BOTH
+    bench_run capng_apply capng_apply BOTH
+)
+
+setup_pseudo() {
+    mkdir "$scratch/pseudo"
+}
+bench_mount_pseudo() {
+    mount_pseudo tmpfs "$scratch/pseudo"
+}
+bench_run_in_mount_ns mount_pseudo setup_pseudo bench_mount_pseudo
+
+setup_inaccessible() {
+    mkdir "$scratch/inaccessible"
+}
+bench_make_inaccessible() {
+    make_inaccessible "$scratch/inaccessible"
+}
+bench_run_in_mount_ns make_inaccessible setup_inaccessible bench_make_inaccessible
+
+setup_accessible() {
+    mkdir "$scratch/dest" "$scratch/paths"
+    paths=()
+    local i
+    for (( i = 0; i < n; ++i )); do
+        touch "$scratch/paths/$i"
+        paths+=( "$scratch/paths/$i" )
+    done
+}
+bench_make_accessible_under() {
+    make_accessible_under "$scratch/dest" "${paths[@]}"
+}
+for n in ${MOUNT_PATHS:-1 8 64}; do
+    bench_run_in_mount_ns "make_accessible_under $n" setup_accessible bench_make_accessible_under
+done
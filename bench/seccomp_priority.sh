@@ -0,0 +1,79 @@
+#!/bin/bash -e
+#
+# Measures the per-syscall overhead of a seccomp filter with default priorities, with
+# priorities set by seccomp_profile_start/seccomp_profile_apply and as a binary tree
+# (CTL_OPTIMIZE 2, which ignores priorities).
+#
+# Output is CSV: filter,nsec_per_syscall
+#
+# Fails if the priorities set from the profile do not reduce the overhead.
+
+source "$(dirname "$0")/lib.sh"
+
+bench_load sandboxing
+
+count=${COUNT:-200000}
+
+workload() {
+    yes | dd of=/dev/null bs=1 count=$count status=none
+}
+
+add_rules() {
+    seccomp_rule_add ERRNO:EPERM "$cold_syscalls"
+    # Never matches, only forces read and write to be checked by the filter.
+    seccomp_rule_add ERRNO:EBADF read,write 'A0_32 == 999'
+}
+
+# Prints elapsed nsec of workload, which is only run once since it is long enough.
+measure() {
+    local start=$EPOCHREALTIME
+    workload
+    local end=$EPOCHREALTIME
+    echo $(( (${end/./} - ${start/./}) * 1000 ))
+}
+
+baseline=$(measure)
+
+default=$(
+    seccomp_init ALLOW
+    add_rules
+    seccomp_load
+    measure
+)
+
+profiled=$(
+    seccomp_profile_start pid
+    if [ "$pid" -eq 0 ]; then
+        workload
+        exit
+    fi
+
+    seccomp_init ALLOW
+    seccomp_profile_apply calls
+    for syscall in "${!calls[@]}"; do
+        echo "$syscall: ${calls[$syscall]} calls" >&2
+    done
+    add_rules
+    seccomp_load
+    measure
+)
+
+binary_tree=$(
+    seccomp_init ALLOW
+    seccomp_attr_set CTL_OPTIMIZE 2
+    add_rules
+    seccomp_load
+    measure
+)
+
+# dd makes 2 syscalls per byte
+echo "filter,nsec_per_syscall"
+echo "none,$(( baseline / (2 * count) ))"
+echo "default,$(( (default - baseline) / (2 * count) ))"
+echo "profiled,$(( (profiled - baseline) / (2 * count) ))"
+echo "binary_tree,$(( (binary_tree - baseline) / (2 * count) ))"
+
+if [ "$profiled" -ge "$default" ]; then
+    echo "profiled priorities are not faster than default" >&2
+    exit 1
+fi
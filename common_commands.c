@@ -1,41 +1,385 @@
 /* fd_ops - loadable builtin that defines fd-related functions */
 
+#define _GNU_SOURCE // For O_PATH
+
 #include "utilities.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <limits.h>
+#include <stdint.h>
+
+#include <sys/param.h> // For MAXSYMLINKS
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <linux/fs.h> // For FICLONE
 
 #include <dlfcn.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
 
+#include "thread_pool.h"
+#include "hash.h"
+
+enum reflink_mode {
+    REFLINK_AUTO,
+    REFLINK_ALWAYS,
+    REFLINK_NEVER,
+};
+
+#define LOOKUP_TABLES_COMMON_COMMANDS
+#include "lookup_tables.h"
+
+/**
+ * Cache of lstat/readlink results of canonical paths, so that paths sharing
+ * the same prefix only walk it once.
+ *
+ * It lives until the end of the call to realpath, or until it is cleared by
+ * 'realpath -c' if '-k' is passed.
+ */
+struct rpath_entry {
+    char *path;   // NULL if the slot is empty
+    char *target; // readlink result if path is a symlink, NULL otherwise
+    mode_t type;  // S_IFMT bits of st_mode
+    int error;    // errno of lstat, 0 if it succeeds
+};
+static struct {
+    size_t size;
+    size_t capacity; // Always power of 2 or 0
+    struct rpath_entry *entries;
+} rpath_cache;
+
+void rpath_cache_clear(void)
+{
+    for (size_t i = 0; i != rpath_cache.capacity; ++i)
+        (free)(rpath_cache.entries[i].path);
+    (free)(rpath_cache.entries);
+
+    rpath_cache.size = 0;
+    rpath_cache.capacity = 0;
+    rpath_cache.entries = NULL;
+}
+
+/**
+ * Called when `common_commands' is disabled.
+ */
+PUBLIC void common_commands_builtin_unload(char *name)
+{
+    rpath_cache_clear();
+}
+/**
+ * @return slot of path in rpath_cache, which might be empty.
+ */
+struct rpath_entry* rpath_cache_find(struct rpath_entry *entries, size_t capacity, const char *path)
+{
+    size_t mask = capacity - 1;
+    size_t i = lookup_hash(path, strlen(path)) & mask;
+    for (; entries[i].path != NULL; i = (i + 1) & mask) {
+        if (strcmp(entries[i].path, path) == 0)
+            break;
+    }
+    return &entries[i];
+}
+/**
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int rpath_cache_reserve(void)
+{
+    if (2 * (rpath_cache.size + 1) <= rpath_cache.capacity)
+        return 0;
+
+    size_t capacity = rpath_cache.capacity == 0 ? 64 : rpath_cache.capacity * 2;
+    struct rpath_entry *entries = calloc(capacity, sizeof(struct rpath_entry));
+    if (entries == NULL)
+        return -1;
+
+    for (size_t i = 0; i != rpath_cache.capacity; ++i) {
+        struct rpath_entry *entry = &rpath_cache.entries[i];
+        if (entry->path != NULL)
+            *rpath_cache_find(entries, capacity, entry->path) = *entry;
+    }
+    (free)(rpath_cache.entries);
+
+    rpath_cache.capacity = capacity;
+    rpath_cache.entries = entries;
+
+    return 0;
+}
+/**
+ * @param path must be absolute and contains no symlink except for the last component.
+ * @return NULL on error with errno set, otherwise the cached result of lstat(path).
+ */
+const struct rpath_entry* rpath_cache_lstat(const char *path)
+{
+    if (rpath_cache.size != 0) {
+        struct rpath_entry *entry = rpath_cache_find(rpath_cache.entries, rpath_cache.capacity, path);
+        if (entry->path != NULL)
+            return entry;
+    }
+
+    if (rpath_cache_reserve() == -1)
+        return NULL;
+
+    struct rpath_entry new_entry = { 0 };
+
+    char target[PATH_MAX];
+    ssize_t target_len = 0;
+
+    struct stat statbuf;
+    if (lstat(path, &statbuf) == -1) {
+        new_entry.error = errno;
+    } else {
+        new_entry.type = statbuf.st_mode & S_IFMT;
+        if (S_ISLNK(statbuf.st_mode)) {
+            target_len = readlink(path, target, sizeof(target));
+            if (target_len == -1)
+                return NULL;
+            if (target_len == sizeof(target)) {
+                errno = ENAMETOOLONG;
+                return NULL;
+            }
+            target[target_len++] = '\0';
+        }
+    }
+
+    size_t path_len = strlen(path) + 1;
+    new_entry.path = malloc(path_len + target_len);
+    if (new_entry.path == NULL)
+        return NULL;
+    memcpy(new_entry.path, path, path_len);
+    if (target_len != 0) {
+        new_entry.target = new_entry.path + path_len;
+        memcpy(new_entry.target, target, target_len);
+    }
+
+    struct rpath_entry *entry = rpath_cache_find(rpath_cache.entries, rpath_cache.capacity, path);
+    *entry = new_entry;
+    ++rpath_cache.size;
+
+    return entry;
+}
+
+/**
+ * Expands all symlinks in path and removes extra '/', '.' and '..'.
+ *
+ * @param cwd buffer of PATH_MAX bytes, filled by getcwd on first use if cwd[0] == '\0'.
+ * @param resolved buffer of PATH_MAX bytes to store the result.
+ * @param allow_missing if non-zero, components that do not exist are appended as is.
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int rpath_resolve(const char *path, char *cwd, char *resolved, int allow_missing)
+{
+    // Unresolved part of path
+    char pending[PATH_MAX];
+    size_t pending_len = strlen(path);
+    if (pending_len == 0) {
+        errno = ENOENT;
+        return -1;
+    }
+    if (pending_len >= sizeof(pending)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    memcpy(pending, path, pending_len + 1);
+
+    // resolved never ends with '/', thus "/" is represented by an empty string.
+    size_t resolved_len = 0;
+    if (path[0] != '/') {
+        if (cwd[0] == '\0' && getcwd(cwd, PATH_MAX) == NULL)
+            return -1;
+        resolved_len = strlen(cwd);
+        memcpy(resolved, cwd, resolved_len);
+        if (resolved_len == 1)
+            resolved_len = 0;
+    }
+
+    // Length of resolved before its first component that does not exist.
+    size_t missing_at = SIZE_MAX;
+
+    size_t nlinks = 0;
+    for (char *p = pending; ; ) {
+        while (*p == '/')
+            ++p;
+        if (*p == '\0')
+            break;
+
+        size_t len = strcspn(p, "/");
+        char *component = p;
+        p += len;
+
+        if (len == 1 && component[0] == '.')
+            continue;
+        if (len == 2 && component[0] == '.' && component[1] == '.') {
+            while (resolved_len != 0 && resolved[--resolved_len] != '/')
+                ;
+            if (resolved_len <= missing_at)
+                missing_at = SIZE_MAX;
+            continue;
+        }
+
+        if (resolved_len + 1 + len >= PATH_MAX) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        size_t parent_len = resolved_len;
+        resolved[resolved_len++] = '/';
+        memcpy(resolved + resolved_len, component, len);
+        resolved_len += len;
+        resolved[resolved_len] = '\0';
+
+        if (missing_at != SIZE_MAX)
+            continue;
+
+        const struct rpath_entry *entry = rpath_cache_lstat(resolved);
+        if (entry == NULL)
+            return -1;
+
+        if (entry->error != 0) {
+            if (!allow_missing || (entry->error != ENOENT && entry->error != ENOTDIR)) {
+                errno = entry->error;
+                return -1;
+            }
+            missing_at = parent_len;
+            continue;
+        }
+
+        if (entry->target == NULL) {
+            if (*p != '\0' && !S_ISDIR(entry->type)) {
+                if (!allow_missing) {
+                    errno = ENOTDIR;
+                    return -1;
+                }
+                missing_at = parent_len;
+            }
+            continue;
+        }
+
+        if (++nlinks > MAXSYMLINKS) {
+            errno = ELOOP;
+            return -1;
+        }
+
+        // Replace the symlink with its target in pending
+        size_t target_len = strlen(entry->target);
+        size_t rest_len = strlen(p);
+        if (target_len + rest_len >= sizeof(pending)) {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        memmove(pending + target_len, p, rest_len + 1);
+        memcpy(pending, entry->target, target_len);
+        p = pending;
+
+        resolved_len = entry->target[0] == '/' ? 0 : parent_len;
+    }
+
+    if (resolved_len == 0)
+        resolved[resolved_len++] = '/';
+    resolved[resolved_len] = '\0';
+
+    return 0;
+}
+
+int realpath_builtin_impl(WORD_LIST *list, const char *arrname, int allow_missing)
+{
+    char cwd[PATH_MAX] = "";
+    char rpath[PATH_MAX];
+
+    if (arrname == NULL) {
+        const char *argv[2];
+        int opt_argc = to_argv_opt(list, 1, 1, argv);
+        if (opt_argc == -1)
+            return (EX_USAGE);
+
+        if (rpath_resolve(argv[0], cwd, rpath, allow_missing) == -1) {
+            warn("realpath failed");
+            return (EXECUTION_FAILURE);
+        }
+
+        if (opt_argc == 1)
+            bind_variable(argv[1], rpath, 0);
+        else
+            puts(rpath);
+
+        return (EXECUTION_SUCCESS);
+    }
+
+    int result = EXECUTION_SUCCESS;
+
+    ARRAY *array = array_cell(make_new_array_variable((char*) arrname));
+    for (arrayind_t i = 0; list != NULL; ++i, list = list->next) {
+        const char *path = list->word->word;
+        if (rpath_resolve(path, cwd, rpath, allow_missing) == -1) {
+            warn("realpath %s failed", path);
+            result = EXECUTION_FAILURE;
+        } else
+            array_append(array, i, rpath);
+    }
+
+    return result;
+}
 int realpath_builtin(WORD_LIST *list)
 {
-    if (check_no_options(&list) == -1)
-        return (EX_USAGE);
+    const char *arrname = NULL;
+    int allow_missing = 0;
+    int keep_cache = 0;
+    int clear_cache = 0;
 
-    const char *argv[2];
-    int opt_argc = to_argv_opt(list, 1, 1, argv);
-    if (opt_argc == -1)
-        return (EX_USAGE);
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "a:emkc")) != -1; ) {
+        switch (opt) {
+        case 'a':
+            arrname = list_optarg;
+            break;
 
-    char *rpath = realpath(argv[0], NULL);
-    if (rpath == NULL) {
-        warn("realpath failed");
-        return (EXECUTION_FAILURE);
+        case 'e':
+            allow_missing = 0;
+            break;
+
+        case 'm':
+            allow_missing = 1;
+            break;
+
+        case 'k':
+            keep_cache = 1;
+            break;
+
+        case 'c':
+            clear_cache = 1;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
     }
+    list = loptend;
 
-    if (opt_argc == 1)
-        bind_variable(argv[1], rpath, 0);
-    else
-        puts(rpath);
+    if (clear_cache)
+        rpath_cache_clear();
 
-    (free)(rpath);
+    int result = EXECUTION_SUCCESS;
+    if (!clear_cache || list != NULL || arrname != NULL)
+        result = realpath_builtin_impl(list, arrname, allow_missing);
 
-    return (EXECUTION_SUCCESS);
+    if (!keep_cache)
+        rpath_cache_clear();
+
+    return result;
 }
 PUBLIC struct builtin realpath_struct = {
     "realpath",             /* builtin name */
@@ -44,49 +388,2132 @@ PUBLIC struct builtin realpath_struct = {
     (char*[]){
         "realpath expands all symlinks and remove extra '/' to produce canonicalized absolute pathname",
         "",
+        "If '-a' is not passed, only one path is resolved.",
         "If var is present, the result is stored in $var.",
         "If not, the result is printed to stdout.",
+        "",
+        "If '-a' is passed, all paths are resolved and stored in outarray with the same index.",
+        "If a path cannot be resolved, its index in outarray is left unset and realpath returns 1",
+        "after all other paths are resolved.",
+        "",
+        "If '-e' is passed (the default), all components of the path must exist.",
+        "If '-m' is passed, components that do not exist are appended as is.",
+        "",
+        "Result of lstat/readlink on each directory prefix is cached, so that paths sharing",
+        "the same prefix only walk it once.",
+        "The cache is dropped on return unless '-k' is passed, in which case it is kept until",
+        "'realpath -c' is called and might be out of date if the filesystem is modified.",
+        "'-c' can be used without any path to only drop the cache.",
         (char*) NULL
     },                      /* array of long documentation strings. */
-    "realpath path [var]",             /* usage synopsis; becomes short_doc */
+    "realpath [-emkc] [-a outarray] paths... / realpath [-emkc] path [var]",             /* usage synopsis; becomes short_doc */
     0                       /* reserved for internal use */
 };
 
-int mkdir_builtin(WORD_LIST *list)
+/**
+ * Stack of dirfds opened for components of the parent of the last path
+ * passed to mkdir, so that paths sharing the same parent only walk it once.
+ */
+struct dirfd_stack {
+    int absolute;
+    int rootfd;        // -1 if "/" is not opened yet
+    size_t depth;
+    size_t capacity;
+    int *fds;          // fds[i] is opened for components 0...i
+    const char **names; // names[i] is component i and is not NUL-terminated
+    size_t *lens;
+};
+
+void dirfd_stack_pop(struct dirfd_stack *stack, size_t depth)
 {
-    if (check_no_options(&list) == -1)
-        return (EX_USAGE);
+    for (; stack->depth > depth; --stack->depth)
+        close(stack->fds[stack->depth - 1]);
+}
+/**
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int dirfd_stack_push(struct dirfd_stack *stack, int fd, const char *name, size_t len)
+{
+    if (stack->depth == stack->capacity) {
+        size_t capacity = stack->capacity == 0 ? 16 : stack->capacity * 2;
 
-    mode_t mode;
-    const char *argv[2];
-    switch (to_argv_opt(list, 1, 1, argv)) {
-        case -1:
-            return (EX_USAGE);
+        int *fds = realloc(stack->fds, capacity * sizeof(int));
+        if (fds == NULL)
+            return -1;
+        stack->fds = fds;
+
+        const char **names = realloc(stack->names, capacity * sizeof(char*));
+        if (names == NULL)
+            return -1;
+        stack->names = names;
+
+        size_t *lens = realloc(stack->lens, capacity * sizeof(size_t));
+        if (lens == NULL)
+            return -1;
+        stack->lens = lens;
+
+        stack->capacity = capacity;
+    }
+
+    stack->fds[stack->depth] = fd;
+    stack->names[stack->depth] = name;
+    stack->lens[stack->depth] = len;
+    ++stack->depth;
+
+    return 0;
+}
+/**
+ * @return dirfd that components of the top of stack are relative to, -1 on error.
+ */
+int dirfd_stack_top(struct dirfd_stack *stack)
+{
+    if (stack->depth != 0)
+        return stack->fds[stack->depth - 1];
+    if (!stack->absolute)
+        return AT_FDCWD;
+
+    if (stack->rootfd == -1)
+        stack->rootfd = open("/", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    return stack->rootfd;
+}
+void dirfd_stack_free(struct dirfd_stack *stack)
+{
+    dirfd_stack_pop(stack, 0);
+    if (stack->rootfd != -1)
+        close(stack->rootfd);
+
+    (free)(stack->fds);
+    (free)(stack->names);
+    (free)(stack->lens);
+}
+
+/**
+ * @param p pointer to the rest of path, which is updated to the end of the component returned.
+ * @return length of the next component of path, 0 if there is none.
+ *         "." is skipped.
+ */
+size_t next_component(const char **p)
+{
+    for (;;) {
+        while (**p == '/')
+            ++*p;
+
+        size_t len = strcspn(*p, "/");
+        if (len != 1 || **p != '.')
+            return len;
+        ++*p;
+    }
+}
+
+int mkdir_impl(struct dirfd_stack *stack, const char *path, mode_t mode, int parents)
+{
+    int absolute = path[0] == '/';
+    if (stack->absolute != absolute) {
+        dirfd_stack_pop(stack, 0);
+        stack->absolute = absolute;
+    }
+
+    if (path[0] == '\0') {
+        errno = ENOENT;
+        return -1;
+    }
+
+    const char *p = path;
+    size_t len = next_component(&p);
+    if (len == 0) {
+        // path is "/" or ".", which always exists.
+        p = ".";
+        len = 1;
+    }
 
-        case 0:
-            mode = S_IRWXU;
+    // Reuse dirfds opened for the previous path
+    size_t level = 0;
+    for (const char *next = p + len; ; ++level) {
+        const char *next_name = next;
+        size_t next_len = next_component(&next_name);
+        if (next_len == 0 || level == stack->depth)
             break;
+        if (stack->lens[level] != len || memcmp(stack->names[level], p, len) != 0)
+            break;
+
+        p = next_name;
+        next = next_name + next_len;
+        len = next_len;
+    }
+    dirfd_stack_pop(stack, level);
+
+    // Open the rest of the parent components
+    for (;;) {
+        const char *next_name = p + len;
+        size_t next_len = next_component(&next_name);
+        if (next_len == 0)
+            break;
+
+        int dirfd = dirfd_stack_top(stack);
+        if (dirfd == -1)
+            return -1;
+
+        char component[len + 1];
+        memcpy(component, p, len);
+        component[len] = '\0';
+
+        if (parents && mkdirat(dirfd, component, mode | S_IWUSR | S_IXUSR) == -1 && errno != EEXIST)
+            return -1;
+
+        int fd = openat(dirfd, component, O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1)
+            return -1;
+        if (dirfd_stack_push(stack, fd, p, len) == -1) {
+            close(fd);
+            return -1;
+        }
+
+        p = next_name;
+        len = next_len;
+    }
+
+    int dirfd = dirfd_stack_top(stack);
+    if (dirfd == -1)
+        return -1;
+
+    char component[len + 1];
+    memcpy(component, p, len);
+    component[len] = '\0';
+
+    if (mkdirat(dirfd, component, mode) == -1) {
+        if (!parents || errno != EEXIST)
+            return -1;
+
+        struct stat statbuf;
+        if (fstatat(dirfd, component, &statbuf, 0) == -1)
+            return -1;
+        if (!S_ISDIR(statbuf.st_mode)) {
+            errno = ENOTDIR;
+            return -1;
+        }
+    }
 
-        case 1:
-            if (str2mode(argv[1], &mode) == -1)
+    return 0;
+}
+int mkdir_builtin(WORD_LIST *list)
+{
+    mode_t mode = S_IRWXU;
+    int parents = 0;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "pm:")) != -1; ) {
+        switch (opt) {
+        case 'p':
+            parents = 1;
+            break;
+
+        case 'm':
+            if (str2mode(list_optarg, &mode) == -1)
                 return (EX_USAGE);
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
     }
+    list = loptend;
 
-    if (mkdir(argv[0], mode) == -1) {
-        warn("mkdir failed");
-        return (EXECUTION_FAILURE);
+    if (list == NULL) {
+        builtin_usage();
+        return (EX_USAGE);
     }
 
-    return (EXECUTION_SUCCESS);
+    int result = EXECUTION_SUCCESS;
+
+    struct dirfd_stack stack = { .rootfd = -1 };
+    for (; list != NULL; list = list->next) {
+        if (mkdir_impl(&stack, list->word->word, mode, parents) == -1) {
+            warn("mkdir %s failed", list->word->word);
+            result = EXECUTION_FAILURE;
+        }
+    }
+    dirfd_stack_free(&stack);
+
+    return result;
 }
 PUBLIC struct builtin mkdir_struct = {
     "mkdir",             /* builtin name */
     mkdir_builtin,       /* function implementing the builtin */
     BUILTIN_ENABLED,        /* initial flags for builtin */
     (char*[]){
+        "mkdir creates directories with mode (default to 0700) subject to umask.",
+        "",
+        "If '-p' is passed, missing parent directories are created with mode | u+wx and",
+        "existing directories are not treated as error.",
+        "",
+        "Parent directories shared by consecutive paths are only opened once.",
+        "If a path cannot be created, mkdir continues with the rest of paths and returns 1.",
+        (char*) NULL
+    },                      /* array of long documentation strings. */
+    "mkdir [-p] [-m mode] paths...",             /* usage synopsis; becomes short_doc */
+    0                       /* reserved for internal use */
+};
+
+/**
+ * Copying of file content is done by copy_file_job on the thread pool, while directories,
+ * symlinks and special files are created by the thread that runs copytree.
+ */
+struct copytree_ctx {
+    struct thread_pool pool;
+    enum reflink_mode reflink;
+    int failed;
+    /**
+     * Number of fds that can still be opened, decremented by 2 for each dir being copied and
+     * file job and incremented back once they are closed. Once it drops below 2, submitting
+     * a file job waits for queued jobs to finish first.
+     */
+    long fds_left;
+    // dst, which is skipped if it is found under src
+    dev_t dst_dev;
+    ino_t dst_ino;
+    size_t path_len;
+    char path[PATH_MAX]; // path relative to src, only used in error message
+};
+struct copy_file_job {
+    struct thread_pool_job job;
+    long *fds_left;
+    enum reflink_mode reflink;
+    int src_fd;
+    int dst_fd;
+    struct stat statbuf;
+    char path[];
+};
+
+/**
+ * Copy [off, off + len) from src_fd to dst_fd.
+ *
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int copy_range(int src_fd, int dst_fd, off_t off, off_t len)
+{
+    static const int fallback_errnos[] = { EXDEV, ENOSYS, EINVAL, EOPNOTSUPP };
+
+    int use_copy_file_range = 1;
+    char buffer[64 * 1024];
+
+    while (len != 0) {
+        ssize_t cnt = -1;
+
+        if (use_copy_file_range) {
+            off_t dst_off = off;
+            cnt = copy_file_range(src_fd, &off, dst_fd, &dst_off, len, 0);
+            if (cnt == -1) {
+                int fallback = 0;
+                for (size_t i = 0; i != sizeof(fallback_errnos) / sizeof(int); ++i)
+                    fallback |= errno == fallback_errnos[i];
+                if (!fallback)
+                    return -1;
+                use_copy_file_range = 0;
+                continue;
+            }
+        } else {
+            cnt = pread(src_fd, buffer, min_unsigned(len, sizeof(buffer)), off);
+            if (cnt == -1)
+                return -1;
+            for (ssize_t written = 0; written != cnt; ) {
+                ssize_t ret = pwrite(dst_fd, buffer + written, cnt - written, off + written);
+                if (ret == -1)
+                    return -1;
+                written += ret;
+            }
+            off += cnt;
+        }
+
+        // The file is truncated concurrently
+        if (cnt == 0)
+            break;
+        len -= cnt;
+    }
+
+    return 0;
+}
+/**
+ * Copy content of src_fd to dst_fd, holes are preserved if the filesystem supports SEEK_HOLE.
+ *
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int copy_content(int src_fd, int dst_fd, off_t size, enum reflink_mode reflink)
+{
+    if (reflink != REFLINK_NEVER) {
+        if (ioctl(dst_fd, FICLONE, src_fd) == 0)
+            return 0;
+        if (reflink == REFLINK_ALWAYS)
+            return -1;
+    }
+
+    for (off_t data = 0; data < size; ) {
+        data = lseek(src_fd, data, SEEK_DATA);
+        if (data == -1) {
+            if (errno == ENXIO) // No more data
+                break;
+            if (errno != EINVAL)
+                return -1;
+            // SEEK_DATA is not supported
+            return copy_range(src_fd, dst_fd, 0, size);
+        }
+
+        off_t hole = lseek(src_fd, data, SEEK_HOLE);
+        if (hole == -1)
+            return -1;
+
+        if (copy_range(src_fd, dst_fd, data, hole - data) == -1)
+            return -1;
+        data = hole;
+    }
+
+    // Creates the trailing hole
+    return ftruncate(dst_fd, size);
+}
+/**
+ * Copy owner, mode and timestamps of statbuf to fd or name relative to dirfd if fd == -1.
+ *
+ * Failure to change owner is ignored unless the process has CAP_CHOWN, like 'cp -a'.
+ *
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int copy_metadata(int fd, int dirfd, const char *name, const struct stat *statbuf)
+{
+    const struct timespec times[2] = { statbuf->st_atim, statbuf->st_mtim };
+
+    int result;
+    if (fd != -1)
+        result = fchown(fd, statbuf->st_uid, statbuf->st_gid);
+    else
+        result = fchownat(dirfd, name, statbuf->st_uid, statbuf->st_gid, AT_SYMLINK_NOFOLLOW);
+    if (result == -1 && errno != EPERM)
+        return -1;
+
+    if (fd != -1) {
+        if (fchmod(fd, statbuf->st_mode & 07777) == -1)
+            return -1;
+        return futimens(fd, times);
+    }
+
+    if (!S_ISLNK(statbuf->st_mode) && fchmodat(dirfd, name, statbuf->st_mode & 07777, 0) == -1)
+        return -1;
+    return utimensat(dirfd, name, times, AT_SYMLINK_NOFOLLOW);
+}
+
+int copy_file_job(struct thread_pool_job *job, struct thread_pool_worker *worker)
+{
+    struct copy_file_job *copy_job = (struct copy_file_job*) job;
+
+    int result = copy_content(copy_job->src_fd, copy_job->dst_fd, copy_job->statbuf.st_size, 
+                              copy_job->reflink);
+    if (result == -1)
+        warn("copytree: failed to copy content of %s", copy_job->path);
+    else if ((result = copy_metadata(copy_job->dst_fd, -1, NULL, &copy_job->statbuf)) == -1)
+        warn("copytree: failed to copy metadata of %s", copy_job->path);
+
+    close(copy_job->src_fd);
+    close(copy_job->dst_fd);
+    __atomic_add_fetch(copy_job->fds_left, 2, __ATOMIC_RELAXED);
+
+    return result;
+}
+
+int copytree_entry(struct copytree_ctx *ctx, int src_dirfd, const char *src_name, 
+                   int dst_dirfd, const char *dst_name);
+
+/**
+ * Append '/' and name to path of PATH_MAX bytes, truncating it if it is too long.
+ *
+ * @return previous length of path.
+ */
+size_t path_push(char *path, size_t *len, const char *name)
+{
+    size_t old_len = *len;
+    if (old_len != 0 && old_len + 1 < PATH_MAX)
+        path[(*len)++] = '/';
+    size_t name_len = min_unsigned(strlen(name), PATH_MAX - 1 - *len);
+    memcpy(path + *len, name, name_len);
+    *len += name_len;
+    path[*len] = '\0';
+    return old_len;
+}
+void path_pop(char *path, size_t *len, size_t old_len)
+{
+    *len = old_len;
+    path[old_len] = '\0';
+}
+
+/**
+ * Copy entries of src_fd into dst_fd, then copy metadata of src_fd to dst_fd.
+ *
+ * Both fds are closed on return.
+ */
+void copytree_dir(struct copytree_ctx *ctx, int src_fd, int dst_fd, const struct stat *statbuf)
+{
+    DIR *dir = fdopendir(src_fd);
+    if (dir == NULL) {
+        warn("copytree: failed to open dir %s", ctx->path);
+        ctx->failed = 1;
+        close(src_fd);
+        close(dst_fd);
+        return;
+    }
+
+    for (struct dirent *entry; (errno = 0, entry = readdir(dir)) != NULL; ) {
+        const char *name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            continue;
+
+        size_t len = path_push(ctx->path, &ctx->path_len, name);
+        copytree_entry(ctx, src_fd, name, dst_fd, name);
+        path_pop(ctx->path, &ctx->path_len, len);
+    }
+    if (errno != 0) {
+        warn("copytree: failed to read dir %s", ctx->path);
+        ctx->failed = 1;
+    }
+
+    // Entries are all created by now and content of files do not affect the mtime of dir.
+    if (copy_metadata(dst_fd, -1, NULL, statbuf) == -1) {
+        warn("copytree: failed to copy metadata of %s", ctx->path);
+        ctx->failed = 1;
+    }
+
+    closedir(dir);
+    close(dst_fd);
+}
+
+/**
+ * @return -1 on error, 0 otherwise.
+ */
+int copytree_entry_impl(struct copytree_ctx *ctx, int src_dirfd, const char *src_name, 
+                        int dst_dirfd, const char *dst_name)
+{
+    struct stat statbuf;
+    if (fstatat(src_dirfd, src_name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1)
+        return -1;
+
+    const int open_flags = O_NOFOLLOW | O_CLOEXEC;
+
+    switch (statbuf.st_mode & S_IFMT) {
+        case S_IFDIR: {
+            // Only the root is relative to cwd.
+            int is_root = src_dirfd == AT_FDCWD;
+
+            // e.g. 'copytree a a/sub', which would otherwise copy dst into itself until
+            // fds run out.
+            if (!is_root && statbuf.st_dev == ctx->dst_dev && statbuf.st_ino == ctx->dst_ino) {
+                warnx("copytree: cannot copy a directory into itself: %s", ctx->path);
+                ctx->failed = 1;
+                return 0;
+            }
+
+            if (mkdirat(dst_dirfd, dst_name, S_IRWXU) == -1)
+                return -1;
+
+            int src_fd = openat(src_dirfd, src_name, O_RDONLY | O_DIRECTORY | open_flags);
+            if (src_fd == -1)
+                return -1;
+
+            int dst_fd = openat(dst_dirfd, dst_name, O_RDONLY | O_DIRECTORY | open_flags);
+            if (dst_fd == -1) {
+                close(src_fd);
+                return -1;
+            }
+
+            if (is_root) {
+                struct stat dst_statbuf;
+                if (fstat(dst_fd, &dst_statbuf) == 0) {
+                    ctx->dst_dev = dst_statbuf.st_dev;
+                    ctx->dst_ino = dst_statbuf.st_ino;
+                }
+            }
+
+            // Dirs do not wait for the budget, as fds of their ancestors are held anyway.
+            __atomic_sub_fetch(&ctx->fds_left, 2, __ATOMIC_RELAXED);
+            copytree_dir(ctx, src_fd, dst_fd, &statbuf);
+            __atomic_add_fetch(&ctx->fds_left, 2, __ATOMIC_RELAXED);
+            return 0;
+        }
+
+        case S_IFREG: {
+            if (__atomic_load_n(&ctx->fds_left, __ATOMIC_RELAXED) < 2)
+                ctx->failed |= thread_pool_wait(&ctx->pool) != 0;
+
+            // Jobs can only be freed here, since workers must not call free.
+            thread_pool_free_finished(&ctx->pool);
+
+            struct copy_file_job *job = malloc(sizeof(struct copy_file_job) + ctx->path_len + 1);
+            if (job == NULL)
+                return -1;
+
+            job->src_fd = openat(src_dirfd, src_name, O_RDONLY | open_flags);
+            if (job->src_fd == -1) {
+                (free)(job);
+                return -1;
+            }
+
+            job->dst_fd = openat(dst_dirfd, dst_name, O_WRONLY | O_CREAT | O_EXCL | open_flags, 
+                                 S_IRUSR | S_IWUSR);
+            if (job->dst_fd == -1) {
+                close(job->src_fd);
+                (free)(job);
+                return -1;
+            }
+
+            __atomic_sub_fetch(&ctx->fds_left, 2, __ATOMIC_RELAXED);
+
+            job->job.func = copy_file_job;
+            job->fds_left = &ctx->fds_left;
+            job->reflink = ctx->reflink;
+            job->statbuf = statbuf;
+            memcpy(job->path, ctx->path, ctx->path_len + 1);
+
+            thread_pool_submit(&ctx->pool, NULL, &job->job);
+            return 0;
+        }
+
+        case S_IFLNK: {
+            char target[PATH_MAX];
+            ssize_t len = readlinkat(src_dirfd, src_name, target, sizeof(target));
+            if (len == -1)
+                return -1;
+            if (len == sizeof(target)) {
+                errno = ENAMETOOLONG;
+                return -1;
+            }
+            target[len] = '\0';
+
+            if (symlinkat(target, dst_dirfd, dst_name) == -1)
+                return -1;
+            break;
+        }
+
+        default:
+            if (mknodat(dst_dirfd, dst_name, statbuf.st_mode, statbuf.st_rdev) == -1)
+                return -1;
+    }
+
+    return copy_metadata(-1, dst_dirfd, dst_name, &statbuf);
+}
+/**
+ * @return -1 on error, 0 otherwise.
+ */
+int copytree_entry(struct copytree_ctx *ctx, int src_dirfd, const char *src_name, 
+                   int dst_dirfd, const char *dst_name)
+{
+    if (copytree_entry_impl(ctx, src_dirfd, src_name, dst_dirfd, dst_name) == -1) {
+        warn("copytree: failed to copy %s", ctx->path);
+        ctx->failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+int copytree_builtin(WORD_LIST *list)
+{
+    size_t nthreads = thread_pool_default_nthreads();
+    enum reflink_mode reflink = REFLINK_AUTO;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "j:r:")) != -1; ) {
+        switch (opt) {
+        case 'j':
+            if (parse_nthreads(list_optarg, &nthreads, "copytree") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'r':
+        {
+            const char *mode = list_optarg;
+            if (strncmp(mode, "reflink=", 8) == 0)
+                mode += 8;
+            if (LOOKUP(reflink_mode, mode, &reflink) == -1) {
+                warnx("copytree: Invalid reflink mode %s", list_optarg);
+                return (EX_USAGE);
+            }
+            break;
+        }
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    const char *argv[2];
+    if (to_argv(list, 2, argv) == -1)
+        return (EX_USAGE);
+
+    struct copytree_ctx *ctx = malloc(sizeof(struct copytree_ctx));
+    if (ctx == NULL) {
+        warn("malloc failed");
+        return (EXECUTION_FAILURE);
+    }
+    ctx->reflink = reflink;
+    ctx->failed = 0;
+    ctx->dst_dev = 0;
+    ctx->dst_ino = 0;
+    ctx->path_len = 0;
+
+    struct rlimit rlimit;
+    if (getrlimit(RLIMIT_NOFILE, &rlimit) == 0 && rlimit.rlim_cur != RLIM_INFINITY)
+        ctx->fds_left = min_unsigned(rlimit.rlim_cur / 2, LONG_MAX);
+    else
+        ctx->fds_left = 512;
+    path_push(ctx->path, &ctx->path_len, argv[0]);
+
+    // Threads other than this one only copy file content, -j 1 is the same as -j 0.
+    if (thread_pool_init(&ctx->pool, nthreads > 1 ? nthreads : 0, 4 * nthreads) == -1) {
+        (free)(ctx);
+        return (EXECUTION_FAILURE);
+    }
+
+    copytree_entry(ctx, AT_FDCWD, argv[0], AT_FDCWD, argv[1]);
+
+    int failed = ctx->failed || thread_pool_wait(&ctx->pool) != 0;
+    thread_pool_free_finished(&ctx->pool);
+    thread_pool_destroy(&ctx->pool);
+    (free)(ctx);
+
+    return failed ? (EXECUTION_FAILURE) : (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin copytree_struct = {
+    "copytree",             /* builtin name */
+    copytree_builtin,       /* function implementing the builtin */
+    BUILTIN_ENABLED,        /* initial flags for builtin */
+    (char*[]){
+        "copytree copies src to dst, which must not exist, like 'cp -a src dst'.",
+        "",
+        "Content of regular files are copied by threads (default to number of online cpus),",
+        "which is set by '-j'.",
+        "",
+        "'-r' sets whether to try reflink (FICLONE) before copy_file_range, which is 'auto'",
+        "by default. If it is 'always', then files that cannot be reflinked are failed,",
+        "if it is 'never', then reflink is never tried.",
+        "",
+        "Holes of files are preserved if the filesystem supports SEEK_HOLE.",
+        "Owner, mode and timestamps are preserved, but hard links, xattrs and ACLs are not.",
+        "",
+        "If any entry cannot be copied, copytree continues with the rest of entries and returns 1.",
+        "If dst is under src, it is skipped instead of being copied into itself, and 1 is returned.",
+        (char*) NULL
+    },                      /* array of long documentation strings. */
+    "copytree [-j threads] [-r auto/always/never] src dst",             /* usage synopsis; becomes short_doc */
+    0                       /* reserved for internal use */
+};
+
+/**
+ * Layout of entries returned by getdents64.
+ */
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+#define LISTDIR_BUFSIZE (256 * 1024)
+
+struct listdir_entry {
+    size_t name_off; // offset into names of listdir_result
+    unsigned char type;
+};
+struct listdir_result {
+    char *names;
+    size_t names_len;
+    size_t names_cap;
+    struct listdir_entry *entries;
+    size_t len;
+    size_t cap;
+};
+
+void listdir_result_free(struct listdir_result *result)
+{
+    (free)(result->names);
+    (free)(result->entries);
+}
+/**
+ * @return -1 on error with errno set, 0 otherwise.
+ */
+int listdir_result_add(struct listdir_result *result, const char *name, unsigned char type)
+{
+    size_t len = strlen(name) + 1;
+
+    if (result->names_len + len > result->names_cap) {
+        size_t cap = result->names_cap == 0 ? 4096 : result->names_cap;
+        while (result->names_len + len > cap)
+            cap *= 2;
+
+        char *names = realloc(result->names, cap);
+        if (names == NULL)
+            return -1;
+        result->names = names;
+        result->names_cap = cap;
+    }
+
+    if (result->len == result->cap) {
+        size_t cap = result->cap == 0 ? 256 : result->cap * 2;
+        struct listdir_entry *entries = realloc(result->entries, cap * sizeof(struct listdir_entry));
+        if (entries == NULL)
+            return -1;
+        result->entries = entries;
+        result->cap = cap;
+    }
+
+    result->entries[result->len++] = (struct listdir_entry){ result->names_len, type };
+    memcpy(result->names + result->names_len, name, len);
+    result->names_len += len;
+
+    return 0;
+}
+int listdir_entry_cmp(const void *x, const void *y, void *names)
+{
+    const struct listdir_entry *entry1 = x;
+    const struct listdir_entry *entry2 = y;
+    return strcmp((char*) names + entry1->name_off, (char*) names + entry2->name_off);
+}
+
+/**
+ * @return letter for d_type in the style of 'find -type'.
+ */
+char dtype2char(unsigned char type)
+{
+    switch (type) {
+        case DT_REG:
+            return 'f';
+        case DT_DIR:
+            return 'd';
+        case DT_LNK:
+            return 'l';
+        case DT_FIFO:
+            return 'p';
+        case DT_SOCK:
+            return 's';
+        case DT_CHR:
+            return 'c';
+        case DT_BLK:
+            return 'b';
+        default:
+            return '?';
+    }
+}
+
+/**
+ * @return 0 on success, non-zero otherwise.
+ */
+int listdir_read(int fd, int all, struct listdir_result *result)
+{
+    char *buffer;
+    START_VLA(char, LISTDIR_BUFSIZE, buffer);
+
+    int ret = 0;
+    for (long nread; (nread = syscall(SYS_getdents64, fd, buffer, LISTDIR_BUFSIZE)) != 0; ) {
+        if (nread == -1) {
+            warn("listdir: getdents64 failed");
+            ret = -1;
+            break;
+        }
+
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *dirent = (struct linux_dirent64*) (buffer + off);
+            off += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.') {
+                if (!all || name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))
+                    continue;
+            }
+
+            if (listdir_result_add(result, name, dirent->d_type) == -1) {
+                warn("listdir: realloc failed");
+                ret = -1;
+                break;
+            }
+        }
+        if (ret == -1)
+            break;
+    }
+
+    END_VLA(buffer);
+
+    return ret;
+}
+
+int listdir_builtin(WORD_LIST *list)
+{
+    int with_types = 0;
+    int all = 0;
+    int sort = 0;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "tas")) != -1; ) {
+        switch (opt) {
+        case 't':
+            with_types = 1;
+            break;
+
+        case 'a':
+            all = 1;
+            break;
+
+        case 's':
+            sort = 1;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    const char *argv[3];
+    if (to_argv(list, 2 + with_types, argv) == -1)
+        return (EX_USAGE);
+
+    int fd = open(argv[0], O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        warn("listdir: open %s failed", argv[0]);
+        return (EXECUTION_FAILURE);
+    }
+
+    struct listdir_result result = { 0 };
+    int ret = listdir_read(fd, all, &result);
+    close(fd);
+
+    if (ret == 0) {
+        if (sort)
+            qsort_r(result.entries, result.len, sizeof(struct listdir_entry), listdir_entry_cmp, 
+                    result.names);
+
+        ARRAY *names = array_cell(make_new_array_variable((char*) argv[1]));
+        ARRAY *types = with_types ? array_cell(make_new_array_variable((char*) argv[2])) : NULL;
+
+        for (size_t i = 0; i != result.len; ++i) {
+            array_append(names, i, result.names + result.entries[i].name_off);
+            if (types != NULL)
+                array_append(types, i, (char[]){ dtype2char(result.entries[i].type), '\0' });
+        }
+    }
+
+    listdir_result_free(&result);
+
+    return ret == 0 ? (EXECUTION_SUCCESS) : (EXECUTION_FAILURE);
+}
+PUBLIC struct builtin listdir_struct = {
+    "listdir",             /* builtin name */
+    listdir_builtin,       /* function implementing the builtin */
+    BUILTIN_ENABLED,        /* initial flags for builtin */
+    (char*[]){
+        "listdir reads names of entries in dir except for '.' and '..' into names_var as array.",
+        "",
+        "If '-a' is passed, names starting with '.' are included.",
+        "If '-s' is passed, names are sorted by bytes, otherwise they are in the order of",
+        "the directory.",
+        "If '-t' is passed, the type of each entry is stored in types_var at the same index",
+        "without calling stat, which is one of f, d, l, p, s, c, b as in 'find -type',",
+        "or '?' if the filesystem does not report it.",
+        (char*) NULL
+    },                      /* array of long documentation strings. */
+    "listdir [-tas] dir names_var [types_var]",             /* usage synopsis; becomes short_doc */
+    0                       /* reserved for internal use */
+};
+
+/**
+ * Comparison in the form of [+-]N used by walk, '+' is greater than and '-' is less than.
+ */
+struct walk_cmp {
+    int enabled;
+    int sign;
+    uintmax_t value;
+};
+/**
+ * @param units suffixes allowed after N, the i-th one multiplies N by 1024^(i + 1).
+ * @return -1 on error, 0 otherwise.
+ */
+int parse_walk_cmp(const char *str, struct walk_cmp *cmp, const char *units)
+{
+    cmp->enabled = 1;
+    cmp->sign = 0;
+    if (*str == '+' || *str == '-')
+        cmp->sign = *str++ == '+' ? 1 : -1;
+
+    char *end;
+    errno = 0;
+    cmp->value = strtoumax(str, &end, 10);
+    if (end == str || *str == '-' || errno != 0) {
+        warnx("walk: Invalid comparison %s", str);
+        return -1;
+    }
+
+    if (*end != '\0') {
+        const char *unit = strchr(units, *end);
+        if (unit == NULL || end[1] != '\0') {
+            warnx("walk: Invalid unit %s", end);
+            return -1;
+        }
+        for (size_t i = 0; i <= unit - units; ++i)
+            cmp->value *= 1024;
+    }
+
+    return 0;
+}
+int walk_cmp_match(const struct walk_cmp *cmp, uintmax_t value)
+{
+    if (!cmp->enabled)
+        return 1;
+    if (cmp->sign > 0)
+        return value > cmp->value;
+    if (cmp->sign < 0)
+        return value < cmp->value;
+    return value == cmp->value;
+}
+
+/**
+ * Directories are read by jobs on the thread pool, each of them opens its subdirectories
+ * relative to its own fd and submits jobs for them.
+ *
+ * Jobs, paths and results found by workers are allocated from the arenas of workers, while
+ * those of roots are allocated from arena of ctx by the thread running walk.
+ */
+struct walk_ctx {
+    struct thread_pool pool;
+    struct arena arena;
+
+    unsigned maxdepth;
+    const char *pattern; // NULL if not set
+    char type;           // '\0' if not set
+    struct walk_cmp mmin;
+    struct walk_cmp size;
+    int du;
+    time_t now;
+
+    /**
+     * Number of fds that can still be held by queued jobs, once it drops to 0 subdirs are
+     * walked by the job that finds them instead, which only holds one fd per level.
+     */
+    long fds_left;
+
+    pthread_mutex_t mutex;  // protects results, nresults and usage
+    struct walk_result *results;
+    size_t nresults;
+    uintmax_t *usage;       // disk usage of each root if du is set
+};
+struct walk_result {
+    struct walk_result *next;
+    const char *path;
+};
+struct walk_job {
+    struct thread_pool_job job;
+    struct walk_ctx *ctx;
+    size_t root;
+    unsigned depth;
+    int fd;             // fd of dir opened relative to its parent, owned by the job
+    int counted;        // whether fd is counted in ctx->fds_left
+    const char *path;
+};
+/**
+ * Results of a job, which are added to ctx once the job is done.
+ */
+struct walk_matched {
+    struct walk_result *head;
+    struct walk_result **tail;
+    size_t len;
+    uintmax_t usage;
+};
+
+int walk_need_stat(const struct walk_ctx *ctx)
+{
+    return ctx->mmin.enabled || ctx->size.enabled || ctx->du;
+}
+/**
+ * @param statbuf NULL if walk_need_stat(ctx) is false.
+ */
+int walk_match(const struct walk_ctx *ctx, const char *name, char type, const struct stat *statbuf)
+{
+    if (ctx->type != '\0' && ctx->type != type)
+        return 0;
+    if (ctx->pattern != NULL && fnmatch(ctx->pattern, name, 0) != 0)
+        return 0;
+    if (statbuf == NULL)
+        return 1;
+
+    uintmax_t age = ctx->now > statbuf->st_mtime ? ctx->now - statbuf->st_mtime : 0;
+    return walk_cmp_match(&ctx->mmin, age / 60) && walk_cmp_match(&ctx->size, statbuf->st_size);
+}
+/**
+ * @return path of name in dir, NULL on error.
+ */
+const char* walk_join(struct arena *arena, const char *dir, const char *name)
+{
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name) + 1;
+    int need_slash = dir_len != 0 && dir[dir_len - 1] != '/';
+
+    char *path = arena_alloc(arena, dir_len + need_slash + name_len);
+    if (path == NULL)
+        return NULL;
+
+    memcpy(path, dir, dir_len);
+    if (need_slash)
+        path[dir_len++] = '/';
+    memcpy(path + dir_len, name, name_len);
+
+    return path;
+}
+/**
+ * @return -1 on error, 0 otherwise.
+ */
+int walk_matched_add(struct walk_matched *matched, struct arena *arena, const char *path)
+{
+    struct walk_result *result = arena_alloc(arena, sizeof(struct walk_result));
+    if (result == NULL)
+        return -1;
+
+    result->next = NULL;
+    result->path = path;
+    *matched->tail = result;
+    matched->tail = &result->next;
+    ++matched->len;
+
+    return 0;
+}
+void walk_matched_merge(struct walk_ctx *ctx, size_t root, struct walk_matched *matched)
+{
+    pthread_mutex_lock(&ctx->mutex);
+    if (ctx->du)
+        ctx->usage[root] += matched->usage;
+    if (matched->head != NULL) {
+        *matched->tail = ctx->results;
+        ctx->results = matched->head;
+        ctx->nresults += matched->len;
+    }
+    pthread_mutex_unlock(&ctx->mutex);
+}
+int walk_dir_job(struct thread_pool_job *thread_pool_job, struct thread_pool_worker *worker);
+
+/**
+ * Submit job for dir fd, which is then owned by the job.
+ *
+ * @param worker NULL if called by the thread running walk.
+ * @return -1 on error, 0 otherwise.
+ */
+int walk_submit(struct walk_ctx *ctx, struct thread_pool_worker *worker, size_t root, 
+                unsigned depth, int fd, int counted, const char *path)
+{
+    struct arena *arena = worker != NULL ? &worker->arena : &ctx->arena;
+
+    struct walk_job *job = arena_alloc(arena, sizeof(struct walk_job));
+    if (job == NULL) {
+        close(fd);
+        if (counted)
+            __atomic_add_fetch(&ctx->fds_left, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    job->job.func = walk_dir_job;
+    job->ctx = ctx;
+    job->root = root;
+    job->depth = depth;
+    job->fd = fd;
+    job->counted = counted;
+    job->path = path;
+
+    thread_pool_submit(&ctx->pool, worker, &job->job);
+    return 0;
+}
+
+int walk_dir(struct walk_ctx *ctx, struct thread_pool_worker *worker, size_t root, 
+             unsigned depth, int fd, const char *dir_path, struct walk_matched *matched);
+
+/**
+ * Open subdir name of fd and either submit it or walk it right away if too many fds
+ * are held by queued jobs.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int walk_subdir(struct walk_ctx *ctx, struct thread_pool_worker *worker, size_t root, 
+                unsigned depth, int fd, const char *name, const char *path, 
+                struct walk_matched *matched)
+{
+    int counted = __atomic_sub_fetch(&ctx->fds_left, 1, __ATOMIC_RELAXED) >= 0;
+    if (!counted)
+        __atomic_add_fetch(&ctx->fds_left, 1, __ATOMIC_RELAXED);
+
+    int subdir_fd = openat(fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (subdir_fd == -1) {
+        warn("walk: open %s failed", path);
+        if (counted)
+            __atomic_add_fetch(&ctx->fds_left, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+
+    if (counted)
+        return walk_submit(ctx, worker, root, depth, subdir_fd, 1, path);
+
+    int ret = walk_dir(ctx, worker, root, depth, subdir_fd, path, matched);
+    close(subdir_fd);
+    return ret;
+}
+/**
+ * Read entries of dir fd at depth, whose path is dir_path.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int walk_dir(struct walk_ctx *ctx, struct thread_pool_worker *worker, size_t root, 
+             unsigned depth, int fd, const char *dir_path, struct walk_matched *matched)
+{
+    ++depth;
+
+    struct arena_mark mark = arena_mark(&worker->scratch);
+    char *buffer = arena_alloc(&worker->scratch, LISTDIR_BUFSIZE);
+    if (buffer == NULL)
+        return -1;
+
+    int ret = 0;
+    for (long nread; (nread = syscall(SYS_getdents64, fd, buffer, LISTDIR_BUFSIZE)) != 0; ) {
+        if (nread == -1) {
+            warn("walk: getdents64 on %s failed", dir_path);
+            ret = -1;
+            break;
+        }
+
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *dirent = (struct linux_dirent64*) (buffer + off);
+            off += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            struct stat statbuf;
+            char type = dtype2char(dirent->d_type);
+            if (walk_need_stat(ctx) || type == '?') {
+                if (fstatat(fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+                    warn("walk: stat %s/%s failed", dir_path, name);
+                    ret = -1;
+                    continue;
+                }
+                type = dtype2char(IFTODT(statbuf.st_mode));
+            }
+
+            int is_match = walk_match(ctx, name, type, walk_need_stat(ctx) ? &statbuf : NULL);
+            if (is_match && ctx->du) {
+                matched->usage += (uintmax_t) statbuf.st_blocks * 512;
+                is_match = 0;
+            }
+            int descend = type == 'd' && depth < ctx->maxdepth;
+            if (!is_match && !descend)
+                continue;
+
+            const char *path = walk_join(&worker->arena, dir_path, name);
+            if (path == NULL || (is_match && walk_matched_add(matched, &worker->arena, path) == -1)) {
+                ret = -1;
+                continue;
+            }
+
+            if (descend && walk_subdir(ctx, worker, root, depth, fd, name, path, matched) == -1)
+                ret = -1;
+        }
+    }
+
+    arena_release(&worker->scratch, &mark);
+    return ret;
+}
+int walk_dir_job(struct thread_pool_job *thread_pool_job, struct thread_pool_worker *worker)
+{
+    struct walk_job *job = (struct walk_job*) thread_pool_job;
+    struct walk_ctx *ctx = job->ctx;
+
+    struct walk_matched matched = { NULL, &matched.head, 0, 0 };
+    int ret = walk_dir(ctx, worker, job->root, job->depth, job->fd, job->path, &matched);
+
+    close(job->fd);
+    if (job->counted)
+        __atomic_add_fetch(&ctx->fds_left, 1, __ATOMIC_RELAXED);
+
+    walk_matched_merge(ctx, job->root, &matched);
+
+    return ret;
+}
+
+/**
+ * Check and descend into root.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int walk_root(struct walk_ctx *ctx, size_t root, const char *path)
+{
+    struct stat statbuf;
+    if (fstatat(AT_FDCWD, path, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+        warn("walk: stat %s failed", path);
+        return -1;
+    }
+
+    char type = dtype2char(IFTODT(statbuf.st_mode));
+
+    const char *name = strrchr(path, '/');
+    name = name == NULL || name[1] == '\0' ? path : name + 1;
+
+    if (walk_match(ctx, name, type, walk_need_stat(ctx) ? &statbuf : NULL)) {
+        struct walk_matched matched = { NULL, &matched.head, 0, 0 };
+        if (ctx->du)
+            matched.usage = (uintmax_t) statbuf.st_blocks * 512;
+        else if (walk_matched_add(&matched, &ctx->arena, path) == -1)
+            return -1;
+        walk_matched_merge(ctx, root, &matched);
+    }
+
+    if (type != 'd' || ctx->maxdepth == 0)
+        return 0;
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        warn("walk: open %s failed", path);
+        return -1;
+    }
+    return walk_submit(ctx, NULL, root, 0, fd, 0, path);
+}
+
+int walk_result_cmp(const void *x, const void *y)
+{
+    return strcmp(*(const char**) x, *(const char**) y);
+}
+int walk_builtin_impl(struct walk_ctx *ctx, WORD_LIST *list, size_t nroots, size_t nthreads)
+{
+    int failed = 0;
+
+    if (thread_pool_init(&ctx->pool, nthreads > 1 ? nthreads : 0, SIZE_MAX) == -1)
+        return (EXECUTION_FAILURE);
+    for (size_t i = 0; i != nroots; ++i, list = list->next)
+        failed |= walk_root(ctx, i, list->word->word) == -1;
+    failed |= thread_pool_wait(&ctx->pool) != 0;
+
+    // Results live in the arenas of workers, which are freed by thread_pool_destroy.
+    const char *arrname = list->word->word;
+    if (ctx->du) {
+        ARRAY *array = array_cell(make_new_array_variable((char*) arrname));
+        char buffer[sizeof(STR(UINTMAX_MAX))];
+        for (size_t i = 0; i != nroots; ++i)
+            array_append(array, i, uint2str(ctx->usage[i], buffer + sizeof(buffer)));
+    } else {
+        const char **paths = malloc(ctx->nresults * sizeof(char*));
+        if (paths == NULL && ctx->nresults != 0) {
+            warn("walk: malloc failed");
+            failed = 1;
+        } else {
+            size_t i = 0;
+            for (struct walk_result *result = ctx->results; result != NULL; result = result->next)
+                paths[i++] = result->path;
+            qsort(paths, ctx->nresults, sizeof(char*), walk_result_cmp);
+
+            ARRAY *array = array_cell(make_new_array_variable((char*) arrname));
+            for (i = 0; i != ctx->nresults; ++i)
+                array_append(array, i, (char*) paths[i]);
+            (free)(paths);
+        }
+    }
+
+    thread_pool_destroy(&ctx->pool);
+
+    return failed ? (EXECUTION_FAILURE) : (EXECUTION_SUCCESS);
+}
+int walk_builtin(WORD_LIST *list)
+{
+    struct walk_ctx ctx = {
+        .arena = { NULL, 0 },
+        .maxdepth = UINT_MAX,
+        .now = time(NULL),
+    };
+    size_t nthreads = thread_pool_default_nthreads();
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "j:d:n:t:m:s:u")) != -1; ) {
+        switch (opt) {
+        case 'j':
+            if (parse_nthreads(list_optarg, &nthreads, "walk") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'd':
+            if (str2uint(list_optarg, &ctx.maxdepth) != 0) {
+                warnx("walk: Invalid maxdepth %s", list_optarg);
+                builtin_usage();
+                return (EX_USAGE);
+            }
+            break;
+
+        case 'n':
+            ctx.pattern = list_optarg;
+            break;
+
+        case 't':
+            if (strlen(list_optarg) != 1 || strchr("fdlpscb", list_optarg[0]) == NULL) {
+                warnx("walk: Invalid type %s", list_optarg);
+                return (EX_USAGE);
+            }
+            ctx.type = list_optarg[0];
+            break;
+
+        case 'm':
+            if (parse_walk_cmp(list_optarg, &ctx.mmin, "") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 's':
+            if (parse_walk_cmp(list_optarg, &ctx.size, "kMG") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'u':
+            ctx.du = 1;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    int argc = list_length(list);
+    if (argc < 2) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+    size_t nroots = argc - 1;
+
+    if (ctx.du) {
+        ctx.usage = calloc(nroots, sizeof(uintmax_t));
+        if (ctx.usage == NULL) {
+            warn("walk: calloc failed");
+            return (EXECUTION_FAILURE);
+        }
+    }
+    pthread_mutex_init(&ctx.mutex, NULL);
+
+    // Leave half of fds to bash and the walk of subdirs that cannot be queued.
+    struct rlimit rlimit;
+    if (getrlimit(RLIMIT_NOFILE, &rlimit) == 0 && rlimit.rlim_cur != RLIM_INFINITY)
+        ctx.fds_left = min_unsigned(rlimit.rlim_cur / 2, LONG_MAX);
+    else
+        ctx.fds_left = 512;
+
+    int result = walk_builtin_impl(&ctx, list, nroots, nthreads);
+
+    pthread_mutex_destroy(&ctx.mutex);
+    arena_free_all(&ctx.arena);
+    (free)(ctx.usage);
+
+    return result;
+}
+PUBLIC struct builtin walk_struct = {
+    "walk",             /* builtin name */
+    walk_builtin,       /* function implementing the builtin */
+    BUILTIN_ENABLED,        /* initial flags for builtin */
+    (char*[]){
+        "walk traverses roots recursively like find and stores matching paths in out_array,",
+        "sorted by bytes. Symlinks are not followed.",
+        "",
+        "Directories are read concurrently by threads (default to number of online cpus),",
+        "which is set by '-j'.",
+        "Subdirs are opened relative to the fd of their parent, thus paths longer than",
+        "PATH_MAX can be walked.",
+        "",
+        "Entries are matched by all of the predicates passed:",
+        " - '-d maxdepth' only descends maxdepth levels below roots, which are at level 0.",
+        " - '-n glob' matches the name of entry against glob.",
+        " - '-t type' matches the type of entry, which is one of f, d, l, p, s, c, b.",
+        " - '-m mtime_cmp' compares minutes since last modification in the form of [+-]N,",
+        "   where '+' is greater than, '-' is less than and no sign is equal to.",
+        " - '-s size_cmp' compares size in the form of [+-]N[kMG].",
+        "",
+        "If '-u' is passed, out_array stores the disk usage in bytes of matching entries",
+        "of each root instead. Hard links are counted once per link.",
+        "",
+        "If an entry cannot be read, walk continues with the rest of entries and returns 1.",
+        (char*) NULL
+    },                      /* array of long documentation strings. */
+    "walk [-u] [-j threads] [-d maxdepth] [-n glob] [-t type] [-m mtime_cmp] [-s size_cmp] roots... out_array",             /* usage synopsis; becomes short_doc */
+    0                       /* reserved for internal use */
+};
+
+#define RMTREE_BUFSIZE (32 * 1024)
+
+/**
+ * State of a thread removing entries, path is only used in error message.
+ */
+struct rmtree_state {
+    /**
+     * Arena for getdents64 buffers: scratch of the worker on the pool, vla_arena otherwise.
+     */
+    struct arena *scratch;
+    int one_fs;
+    dev_t dev;
+    size_t path_len;
+    char path[PATH_MAX];
+};
+struct rmtree_job {
+    struct thread_pool_job job;
+    int parent_fd;
+    size_t name_off; // offset of name in state.path
+    struct rmtree_state state;
+};
+
+int rmtree_at(int parent_fd, const char *name, unsigned char type, struct rmtree_state *state);
+
+/**
+ * Remove all entries of dir fd.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int rmtree_contents(int fd, struct rmtree_state *state)
+{
+    struct arena_mark mark = arena_mark(state->scratch);
+    char *buffer = arena_alloc(state->scratch, RMTREE_BUFSIZE);
+    if (buffer == NULL)
+        return -1;
+
+    int ret = 0;
+    for (long nread; (nread = syscall(SYS_getdents64, fd, buffer, RMTREE_BUFSIZE)) != 0; ) {
+        if (nread == -1) {
+            warn("rmtree: getdents64 on %s failed", state->path);
+            ret = -1;
+            break;
+        }
+
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *dirent = (struct linux_dirent64*) (buffer + off);
+            off += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            size_t len = path_push(state->path, &state->path_len, name);
+            if (rmtree_at(fd, name, dirent->d_type, state) == -1)
+                ret = -1;
+            path_pop(state->path, &state->path_len, len);
+        }
+    }
+
+    arena_release(state->scratch, &mark);
+    return ret;
+}
+/**
+ * Remove dir name in parent_fd once its entries are removed.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int rmtree_rmdir(int parent_fd, const char *name, int fd, struct rmtree_state *state)
+{
+    if (unlinkat(parent_fd, name, AT_REMOVEDIR) == -1) {
+        // Entries might be created concurrently or missed by getdents64, try once more.
+        if (errno != ENOTEMPTY || lseek(fd, 0, SEEK_SET) == -1 || 
+            rmtree_contents(fd, state) == -1 || unlinkat(parent_fd, name, AT_REMOVEDIR) == -1) {
+            warn("rmtree: rmdir %s failed", state->path);
+            return -1;
+        }
+    }
+    return 0;
+}
+/**
+ * @return fd of dir name in parent_fd, -1 on error.
+ */
+int rmtree_opendir(int parent_fd, const char *name, struct rmtree_state *state)
+{
+    int fd = openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        warn("rmtree: open %s failed", state->path);
+        return -1;
+    }
+
+    if (state->one_fs) {
+        struct stat statbuf;
+        if (fstat(fd, &statbuf) == -1) {
+            warn("rmtree: stat %s failed", state->path);
+            close(fd);
+            return -1;
+        }
+        if (statbuf.st_dev != state->dev) {
+            warnx("rmtree: skipping %s, which is on a different filesystem", state->path);
+            close(fd);
+            return -1;
+        }
+    }
+
+    return fd;
+}
+/**
+ * Remove name in parent_fd recursively.
+ *
+ * Dirs are opened with O_NOFOLLOW relative to their parent, so replacing any of them
+ * with a symlink cannot redirect the removal outside of the tree.
+ *
+ * @param type d_type of name
+ * @return -1 on error, 0 otherwise.
+ */
+int rmtree_at(int parent_fd, const char *name, unsigned char type, struct rmtree_state *state)
+{
+    if (type == DT_UNKNOWN) {
+        struct stat statbuf;
+        if (fstatat(parent_fd, name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+            warn("rmtree: stat %s failed", state->path);
+            return -1;
+        }
+        type = IFTODT(statbuf.st_mode);
+    }
+
+    if (type != DT_DIR) {
+        if (unlinkat(parent_fd, name, 0) == -1) {
+            warn("rmtree: unlink %s failed", state->path);
+            return -1;
+        }
+        return 0;
+    }
+
+    int fd = rmtree_opendir(parent_fd, name, state);
+    if (fd == -1)
+        return -1;
+
+    int ret = rmtree_contents(fd, state);
+    if (ret == 0)
+        ret = rmtree_rmdir(parent_fd, name, fd, state);
+
+    close(fd);
+    return ret;
+}
+
+int rmtree_job(struct thread_pool_job *job, struct thread_pool_worker *worker)
+{
+    struct rmtree_job *rm_job = (struct rmtree_job*) job;
+    struct rmtree_state *state = &rm_job->state;
+    state->scratch = &worker->scratch;
+
+    return rmtree_at(rm_job->parent_fd, state->path + rm_job->name_off, DT_DIR, state);
+}
+
+/**
+ * Dirs passed to rmtree that are removed once all their subdirs are removed on the pool.
+ */
+#define RMTREE_MAX_PENDING_ROOTS 64
+
+struct rmtree_root {
+    int fd;
+    int failed;
+    const char *path;
+};
+struct rmtree_ctx {
+    struct thread_pool pool;
+    int one_fs;
+    dev_t root_dev;
+    ino_t root_ino;
+    size_t npending;
+    struct rmtree_root pending[RMTREE_MAX_PENDING_ROOTS];
+};
+
+/**
+ * Wait for subdirs of pending roots to be removed, then remove the roots.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int rmtree_flush_roots(struct rmtree_ctx *ctx)
+{
+    int jobs_failed = thread_pool_wait(&ctx->pool) != 0;
+    thread_pool_free_finished(&ctx->pool);
+    int ret = jobs_failed ? -1 : 0;
+
+    for (size_t i = 0; i != ctx->npending; ++i) {
+        struct rmtree_root *root = &ctx->pending[i];
+
+        if (jobs_failed || root->failed) {
+            // Entries that cannot be removed are already reported
+            if (unlinkat(AT_FDCWD, root->path, AT_REMOVEDIR) == -1 && errno != ENOTEMPTY)
+                warn("rmtree: rmdir %s failed", root->path);
+            ret = -1;
+        } else {
+            struct rmtree_state state = { .scratch = &vla_arena, .path_len = 0 };
+            path_push(state.path, &state.path_len, root->path);
+            if (rmtree_rmdir(AT_FDCWD, root->path, root->fd, &state) == -1)
+                ret = -1;
+        }
+        close(root->fd);
+    }
+    ctx->npending = 0;
+
+    return ret;
+}
+/**
+ * Remove entries of root and submit its subdirs to the pool.
+ *
+ * @return -1 on error, 0 otherwise.
+ */
+int rmtree_root(struct rmtree_ctx *ctx, const char *path)
+{
+    // Trailing slashes are ignored like rm does, so that './' and '../' are refused as well.
+    size_t end = strlen(path);
+    while (end > 1 && path[end - 1] == '/')
+        --end;
+    size_t start = end;
+    while (start != 0 && path[start - 1] != '/')
+        --start;
+    if ((end - start == 1 || end - start == 2) && strncmp(path + start, "..", end - start) == 0) {
+        warnx("rmtree: refusing to remove '.' or '..' directory: %s", path);
+        return -1;
+    }
+
+    struct stat statbuf;
+    if (fstatat(AT_FDCWD, path, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+        if (errno == ENOENT)
+            return 0;
+        warn("rmtree: stat %s failed", path);
+        return -1;
+    }
+
+    if (!S_ISDIR(statbuf.st_mode)) {
+        if (unlinkat(AT_FDCWD, path, 0) == -1) {
+            warn("rmtree: unlink %s failed", path);
+            return -1;
+        }
+        return 0;
+    }
+
+    if (statbuf.st_dev == ctx->root_dev && statbuf.st_ino == ctx->root_ino) {
+        warnx("rmtree: refusing to remove '/'");
+        return -1;
+    }
+
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd == -1) {
+        warn("rmtree: open %s failed", path);
+        return -1;
+    }
+
+    // Failure of earlier roots is already reported and must not prevent removal of this one.
+    int flush_failed = 0;
+    if (ctx->npending == RMTREE_MAX_PENDING_ROOTS)
+        flush_failed = rmtree_flush_roots(ctx) == -1;
+    struct rmtree_root *root = &ctx->pending[ctx->npending++];
+    *root = (struct rmtree_root){ fd, 1, path };
+
+    char *buffer = malloc(RMTREE_BUFSIZE);
+    if (buffer == NULL) {
+        warn("rmtree: malloc failed");
+        return -1;
+    }
+
+    struct rmtree_state state = {
+        .scratch = &vla_arena,
+        .one_fs = ctx->one_fs,
+        .dev = statbuf.st_dev,
+        .path_len = 0,
+    };
+    path_push(state.path, &state.path_len, path);
+
+    int ret = 0;
+    for (long nread; (nread = syscall(SYS_getdents64, fd, buffer, RMTREE_BUFSIZE)) != 0; ) {
+        if (nread == -1) {
+            warn("rmtree: getdents64 on %s failed", path);
+            ret = -1;
+            break;
+        }
+
+        for (long off = 0; off < nread; ) {
+            struct linux_dirent64 *dirent = (struct linux_dirent64*) (buffer + off);
+            off += dirent->d_reclen;
+
+            const char *name = dirent->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            size_t len = path_push(state.path, &state.path_len, name);
+
+            unsigned char type = dirent->d_type;
+            if (type == DT_UNKNOWN) {
+                struct stat entry_statbuf;
+                if (fstatat(fd, name, &entry_statbuf, AT_SYMLINK_NOFOLLOW) == 0)
+                    type = IFTODT(entry_statbuf.st_mode);
+            }
+
+            struct rmtree_job *job;
+            // name in state.path is truncated if it is too long
+            int truncated = strcmp(state.path + len + 1, name) != 0;
+            if (type == DT_DIR && !truncated)
+                thread_pool_free_finished(&ctx->pool);
+            if (type != DT_DIR || truncated || (job = malloc(sizeof(struct rmtree_job))) == NULL) {
+                if (rmtree_at(fd, name, type, &state) == -1)
+                    ret = -1;
+            } else {
+                job->job.func = rmtree_job;
+                job->parent_fd = fd;
+                job->name_off = len + 1;
+                job->state = state;
+                thread_pool_submit(&ctx->pool, NULL, &job->job);
+            }
+
+            path_pop(state.path, &state.path_len, len);
+        }
+    }
+
+    (free)(buffer);
+
+    root->failed = ret == -1;
+    return ret == -1 || flush_failed ? -1 : 0;
+}
+
+int rmtree_builtin(WORD_LIST *list)
+{
+    size_t nthreads = thread_pool_default_nthreads();
+    int one_fs = 0;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "j:x")) != -1; ) {
+        switch (opt) {
+        case 'j':
+            if (parse_nthreads(list_optarg, &nthreads, "rmtree") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'x':
+            one_fs = 1;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    if (list == NULL) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    struct stat root_statbuf;
+    if (stat("/", &root_statbuf) == -1) {
+        warn("rmtree: stat / failed");
+        return (EXECUTION_FAILURE);
+    }
+
+    struct rmtree_ctx *ctx = malloc(sizeof(struct rmtree_ctx));
+    if (ctx == NULL) {
+        warn("malloc failed");
+        return (EXECUTION_FAILURE);
+    }
+    ctx->one_fs = one_fs;
+    ctx->root_dev = root_statbuf.st_dev;
+    ctx->root_ino = root_statbuf.st_ino;
+    ctx->npending = 0;
+
+    if (thread_pool_init(&ctx->pool, nthreads > 1 ? nthreads : 0, 4 * nthreads) == -1) {
+        (free)(ctx);
+        return (EXECUTION_FAILURE);
+    }
+
+    int failed = 0;
+    for (; list != NULL; list = list->next)
+        failed |= rmtree_root(ctx, list->word->word) == -1;
+    failed |= rmtree_flush_roots(ctx) == -1;
+
+    thread_pool_destroy(&ctx->pool);
+    (free)(ctx);
+
+    return failed ? (EXECUTION_FAILURE) : (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin rmtree_struct = {
+    "rmtree",             /* builtin name */
+    rmtree_builtin,       /* function implementing the builtin */
+    BUILTIN_ENABLED,        /* initial flags for builtin */
+    (char*[]){
+        "rmtree removes paths recursively like 'rm -rf', paths that do not exist are ignored.",
+        "",
+        "Entries are removed by unlinkat relative to the fd of their parent dir, which is",
+        "opened with O_NOFOLLOW, thus symlinks are removed but never followed.",
+        "",
+        "Subdirs of each path are removed in parallel by threads (default to number of",
+        "online cpus), which is set by '-j'.",
+        "If '-x' is passed, dirs on filesystems other than the one of path are skipped.",
+        "",
+        "If an entry cannot be removed, rmtree continues with the rest of entries and returns 1.",
+        (char*) NULL
+    },                      /* array of long documentation strings. */
+    "rmtree [-x] [-j threads] paths...",             /* usage synopsis; becomes short_doc */
+    0                       /* reserved for internal use */
+};
+
+#define FHASH_BUFSIZE (256 * 1024)
+
+/**
+ * Digest in hex, empty if failed.
+ */
+typedef char fhash_digest[17];
+
+struct fhash_job {
+    struct thread_pool_job job;
+    enum hash_algo algo;
+    int fd;           // -1 if file is a path
+    const char *file;
+    char *digest;
+};
+
+/**
+ * Hash content of fd from its current offset.
+ *
+ * Files are read instead of mmaped, as a file truncated by another process while it is
+ * being hashed would raise SIGBUS and kill the shell.
+ *
+ * @param scratch arena of the thread calling it, for the buffer.
+ * @return -1 on error, 0 otherwise.
+ */
+int fhash_read(int fd, struct hash_state *state, const char *file, struct arena *scratch)
+{
+    struct arena_mark mark = arena_mark(scratch);
+    char *buffer = arena_alloc(scratch, FHASH_BUFSIZE);
+    if (buffer == NULL)
+        return -1;
+
+    ssize_t cnt;
+    while ((cnt = read(fd, buffer, FHASH_BUFSIZE)) != 0) {
+        if (cnt == -1) {
+            if (errno == EINTR)
+                continue;
+            warn("fhash: read %s failed", file);
+            break;
+        }
+        hash_update(state, buffer, cnt);
+    }
+
+    arena_release(scratch, &mark);
+    return cnt == 0 ? 0 : -1;
+}
+int fhash_job(struct thread_pool_job *job, struct thread_pool_worker *worker)
+{
+    struct fhash_job *hash_job = (struct fhash_job*) job;
+
+    struct hash_state state;
+    hash_init(&state, hash_job->algo);
+
+    int ret;
+    if (hash_job->fd != -1)
+        ret = fhash_read(hash_job->fd, &state, hash_job->file, &worker->scratch);
+    else {
+        int fd = open(hash_job->file, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            warn("fhash: open %s failed", hash_job->file);
+            ret = -1;
+        } else {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            ret = fhash_read(fd, &state, hash_job->file, &worker->scratch);
+            close(fd);
+        }
+    }
+
+    if (ret == 0)
+        hash_final_hex(&state, hash_job->digest);
+
+    return ret;
+}
+
+/**
+ * @return -1 on error, 0 otherwise.
+ */
+int parse_hash_algo(const char *arg, enum hash_algo *algo, const char *self_name)
+{
+    if (LOOKUP(hash_algo, arg, algo) == -1) {
+        warnx("%s: Invalid algorithm %s, expected xxh64 or crc32c", self_name, arg);
+        return -1;
+    }
+    return 0;
+}
+
+int fhash_builtin_impl(WORD_LIST *list, int nfiles, fhash_digest *digests, 
+                       enum hash_algo algo, int is_fd, size_t nthreads)
+{
+    int failed = 0;
+
+    // Jobs are owned by this thread, since workers must not call free.
+    struct fhash_job *jobs;
+    START_VLA(struct fhash_job, nfiles, jobs);
+
+    struct thread_pool pool;
+    if (thread_pool_init(&pool, nthreads > 1 ? nthreads : 0, 4 * nthreads) == -1) {
+        END_VLA(jobs);
+        return (EXECUTION_FAILURE);
+    }
+
+    WORD_LIST *l = list;
+    for (int i = 0; i != nfiles; ++i, l = l->next) {
+        digests[i][0] = '\0';
+
+        int fd = -1;
+        if (is_fd && str2fd(l->word->word, &fd) == -1) {
+            failed = 1;
+            continue;
+        }
+
+        struct fhash_job *job = &jobs[i];
+        job->job.func = fhash_job;
+        job->algo = algo;
+        job->fd = fd;
+        job->file = l->word->word;
+        job->digest = digests[i];
+
+        thread_pool_submit(&pool, NULL, &job->job);
+    }
+
+    failed |= thread_pool_wait(&pool) != 0;
+    thread_pool_destroy(&pool);
+    END_VLA(jobs);
+
+    ARRAY *array = array_cell(make_new_array_variable(l->word->word));
+    for (int i = 0; i != nfiles; ++i) {
+        if (digests[i][0] != '\0')
+            array_append(array, i, digests[i]);
+    }
+
+    return failed ? (EXECUTION_FAILURE) : (EXECUTION_SUCCESS);
+}
+int fhash_builtin(WORD_LIST *list)
+{
+    enum hash_algo algo = HASH_XXH64;
+    size_t nthreads = thread_pool_default_nthreads();
+    int is_fd = 0;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "a:j:F")) != -1; ) {
+        switch (opt) {
+        case 'a':
+            if (parse_hash_algo(list_optarg, &algo, "fhash") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'j':
+            if (parse_nthreads(list_optarg, &nthreads, "fhash") == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'F':
+            is_fd = 1;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    int argc = list_length(list);
+    if (argc < 2) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+    int nfiles = argc - 1;
+
+    hash_global_init();
+
+    fhash_digest *digests;
+    START_VLA(fhash_digest, nfiles, digests);
+    int result = fhash_builtin_impl(list, nfiles, digests, algo, is_fd, nthreads);
+    END_VLA(digests);
+
+    return result;
+}
+PUBLIC struct builtin fhash_struct = {
+    "fhash",             /* builtin name */
+    fhash_builtin,       /* function implementing the builtin */
+    BUILTIN_ENABLED,        /* initial flags for builtin */
+    (char*[]){
+        "fhash hashes content of files and stores the digests in hex in out_array with the",
+        "same index.",
+        "",
+        "'-a' sets the algorithm, which is one of xxh64 (the default) and crc32c.",
+        "They are meant to be used as cache keys and are NOT cryptographic hashes.",
+        "",
+        "Files are hashed in parallel by threads (default to number of online cpus),",
+        "which is set by '-j'.",
+        "If '-F' is passed, files are fds, which are read from their current offset.",
+        "",
+        "If a file cannot be read, its index is left unset and fhash returns 1.",
+        (char*) NULL
+    },                      /* array of long documentation strings. */
+    "fhash [-F] [-a algo] [-j threads] files... out_array",             /* usage synopsis; becomes short_doc */
+    0                       /* reserved for internal use */
+};
+
+int strhash_builtin(WORD_LIST *list)
+{
+    enum hash_algo algo = HASH_XXH64;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "a:")) != -1; ) {
+        switch (opt) {
+        case 'a':
+            if (parse_hash_algo(list_optarg, &algo, "strhash") == -1)
+                return (EX_USAGE);
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    int argc = list_length(list);
+    if (argc < 2) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    hash_global_init();
+
+    WORD_LIST *arrname = list;
+    for (int i = 0; i != argc - 1; ++i)
+        arrname = arrname->next;
+
+    ARRAY *array = array_cell(make_new_array_variable(arrname->word->word));
+    for (arrayind_t i = 0; list != arrname; ++i, list = list->next) {
+        const char *str = list->word->word;
+
+        struct hash_state state;
+        hash_init(&state, algo);
+        hash_update(&state, str, strlen(str));
+
+        fhash_digest digest;
+        hash_final_hex(&state, digest);
+        array_append(array, i, digest);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin strhash_struct = {
+    "strhash",             /* builtin name */
+    strhash_builtin,       /* function implementing the builtin */
+    BUILTIN_ENABLED,        /* initial flags for builtin */
+    (char*[]){
+        "strhash is the same as fhash, except that it hashes strings.",
         (char*) NULL
     },                      /* array of long documentation strings. */
-    "mkdir path [mode]",             /* usage synopsis; becomes short_doc */
+    "strhash [-a algo] strings... out_array",             /* usage synopsis; becomes short_doc */
     0                       /* reserved for internal use */
 };
 
@@ -111,6 +2538,12 @@ int common_commands_builtin(WORD_LIST *_)
 
         { .word = "realpath", .flags = 0 },
         { .word = "mkdir", .flags = 0 },
+        { .word = "copytree", .flags = 0 },
+        { .word = "listdir", .flags = 0 },
+        { .word = "walk", .flags = 0 },
+        { .word = "rmtree", .flags = 0 },
+        { .word = "fhash", .flags = 0 },
+        { .word = "strhash", .flags = 0 },
     };
 
     const size_t builtin_num = sizeof(words) / sizeof(WORD_DESC);
@@ -1,302 +0,0 @@
-#ifndef  __bash_loadables_errnos_H_
-# define __bash_loadables_errnos_H_
-
-# include <errno.h>
-
-/**
- * Generated by gather all errnos from "errno.h" to "errnos.txt", and run
- *     for line in $(cut  -f 1 errnos.txt | sort); do     echo "\"${line}\","; done
- * over it, copies the result to here and remove prefixing 'E' to save a few bytes.
- *
- * The array itself takes about 1KB, and the string in the array takes another 1KB.
- */
-static const char* const errno_strs[] = {
-    "2BIG",
-    "ACCES",
-    "ADDRINUSE",
-    "ADDRNOTAVAIL",
-    "ADV",
-    "AFNOSUPPORT",
-    "AGAIN",
-    "ALREADY",
-    "BADE",
-    "BADF",
-    "BADFD",
-    "BADMSG",
-    "BADR",
-    "BADRQC",
-    "BADSLT",
-    "BFONT",
-    "BUSY",
-    "CANCELED",
-    "CANCELED",
-    "CHILD",
-    "CHRNG",
-    "COMM",
-    "CONNABORTED",
-    "CONNREFUSED",
-    "CONNRESET",
-    "DEADLK",
-    "DEADLOCK",
-    "DESTADDRREQ",
-    "DOM",
-    "DOTDOT",
-    "DQUOT",
-    "EXIST",
-    "FAULT",
-    "FBIG",
-    "HOSTDOWN",
-    "HOSTUNREACH",
-    "HWPOISON",
-    "HWPOISON",
-    "IDRM",
-    "ILSEQ",
-    "INPROGRESS",
-    "INTR",
-    "INVAL",
-    "IO",
-    "ISCONN",
-    "ISDIR",
-    "ISNAM",
-    "KEYEXPIRED",
-    "KEYREJECTED",
-    "KEYREVOKED",
-    "L2HLT",
-    "L2NSYNC",
-    "L3HLT",
-    "L3RST",
-    "LIBACC",
-    "LIBBAD",
-    "LIBEXEC",
-    "LIBMAX",
-    "LIBSCN",
-    "LNRNG",
-    "LOOP",
-    "MEDIUMTYPE",
-    "MFILE",
-    "MLINK",
-    "MSGSIZE",
-    "MULTIHOP",
-    "NAMETOOLONG",
-    "NAVAIL",
-    "NETDOWN",
-    "NETRESET",
-    "NETUNREACH",
-    "NFILE",
-    "NOANO",
-    "NOBUFS",
-    "NOCSI",
-    "NODATA",
-    "NODEV",
-    "NOENT",
-    "NOEXEC",
-    "NOKEY",
-    "NOLCK",
-    "NOLINK",
-    "NOMEDIUM",
-    "NOMEM",
-    "NOMSG",
-    "NONET",
-    "NOPKG",
-    "NOPROTOOPT",
-    "NOSPC",
-    "NOSR",
-    "NOSTR",
-    "NOSYS",
-    "NOTBLK",
-    "NOTCONN",
-    "NOTDIR",
-    "NOTEMPTY",
-    "NOTNAM",
-    "NOTRECOVERABLE",
-    "NOTRECOVERABLE",
-    "NOTSOCK",
-    "NOTSUP",
-    "NOTTY",
-    "NOTUNIQ",
-    "NXIO",
-    "OPNOTSUPP",
-    "OVERFLOW",
-    "OWNERDEAD",
-    "OWNERDEAD",
-    "PERM",
-    "PFNOSUPPORT",
-    "PIPE",
-    "PROTO",
-    "PROTONOSUPPORT",
-    "PROTOTYPE",
-    "RANGE",
-    "REMCHG",
-    "REMOTE",
-    "REMOTEIO",
-    "RESTART",
-    "RFKILL",
-    "RFKILL",
-    "ROFS",
-    "SHUTDOWN",
-    "SOCKTNOSUPPORT",
-    "SPIPE",
-    "SRCH",
-    "SRMNT",
-    "STALE",
-    "STRPIPE",
-    "TIME",
-    "TIMEDOUT",
-    "TOOMANYREFS",
-    "TXTBSY",
-    "UCLEAN",
-    "UNATCH",
-    "USERS",
-    "WOULDBLOCK",
-    "XDEV",
-    "XFULL",
-};
-
-/**
- * This is a one-to-one map of errno_strs.
- *
- * This array itself takes about half a KB.
- */
-static const int errnos[] = {
-    E2BIG,
-    EACCES,
-    EADDRINUSE,
-    EADDRNOTAVAIL,
-    EADV,
-    EAFNOSUPPORT,
-    EAGAIN,
-    EALREADY,
-    EBADE,
-    EBADF,
-    EBADFD,
-    EBADMSG,
-    EBADR,
-    EBADRQC,
-    EBADSLT,
-    EBFONT,
-    EBUSY,
-    ECANCELED,
-    ECANCELED,
-    ECHILD,
-    ECHRNG,
-    ECOMM,
-    ECONNABORTED,
-    ECONNREFUSED,
-    ECONNRESET,
-    EDEADLK,
-    EDEADLOCK,
-    EDESTADDRREQ,
-    EDOM,
-    EDOTDOT,
-    EDQUOT,
-    EEXIST,
-    EFAULT,
-    EFBIG,
-    EHOSTDOWN,
-    EHOSTUNREACH,
-    EHWPOISON,
-    EHWPOISON,
-    EIDRM,
-    EILSEQ,
-    EINPROGRESS,
-    EINTR,
-    EINVAL,
-    EIO,
-    EISCONN,
-    EISDIR,
-    EISNAM,
-    EKEYEXPIRED,
-    EKEYREJECTED,
-    EKEYREVOKED,
-    EL2HLT,
-    EL2NSYNC,
-    EL3HLT,
-    EL3RST,
-    ELIBACC,
-    ELIBBAD,
-    ELIBEXEC,
-    ELIBMAX,
-    ELIBSCN,
-    ELNRNG,
-    ELOOP,
-    EMEDIUMTYPE,
-    EMFILE,
-    EMLINK,
-    EMSGSIZE,
-    EMULTIHOP,
-    ENAMETOOLONG,
-    ENAVAIL,
-    ENETDOWN,
-    ENETRESET,
-    ENETUNREACH,
-    ENFILE,
-    ENOANO,
-    ENOBUFS,
-    ENOCSI,
-    ENODATA,
-    ENODEV,
-    ENOENT,
-    ENOEXEC,
-    ENOKEY,
-    ENOLCK,
-    ENOLINK,
-    ENOMEDIUM,
-    ENOMEM,
-    ENOMSG,
-    ENONET,
-    ENOPKG,
-    ENOPROTOOPT,
-    ENOSPC,
-    ENOSR,
-    ENOSTR,
-    ENOSYS,
-    ENOTBLK,
-    ENOTCONN,
-    ENOTDIR,
-    ENOTEMPTY,
-    ENOTNAM,
-    ENOTRECOVERABLE,
-    ENOTRECOVERABLE,
-    ENOTSOCK,
-    ENOTSUP,
-    ENOTTY,
-    ENOTUNIQ,
-    ENXIO,
-    EOPNOTSUPP,
-    EOVERFLOW,
-    EOWNERDEAD,
-    EOWNERDEAD,
-    EPERM,
-    EPFNOSUPPORT,
-    EPIPE,
-    EPROTO,
-    EPROTONOSUPPORT,
-    EPROTOTYPE,
-    ERANGE,
-    EREMCHG,
-    EREMOTE,
-    EREMOTEIO,
-    ERESTART,
-    ERFKILL,
-    ERFKILL,
-    EROFS,
-    ESHUTDOWN,
-    ESOCKTNOSUPPORT,
-    ESPIPE,
-    ESRCH,
-    ESRMNT,
-    ESTALE,
-    ESTRPIPE,
-    ETIME,
-    ETIMEDOUT,
-    ETOOMANYREFS,
-    ETXTBSY,
-    EUCLEAN,
-    EUNATCH,
-    EUSERS,
-    EWOULDBLOCK,
-    EXDEV,
-    EXFULL,
-};
-
-#endif
@@ -0,0 +1,285 @@
+#ifndef  __bash_loadables_hash_H_
+# define __bash_loadables_hash_H_
+
+/**
+ * Non-cryptographic hashes of contents used by fhash and strhash, implemented here so that
+ * no external library is required:
+ *  - XXH64 as specified by https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ *  - CRC32C (Castagnoli), using the crc32 instruction of SSE4.2 if the cpu supports it.
+ *
+ * hash_global_init must be called before any state is used by threads.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+enum hash_algo {
+    HASH_XXH64,
+    HASH_CRC32C,
+};
+
+#define XXH64_PRIME1 0x9E3779B185EBCA87ULL
+#define XXH64_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define XXH64_PRIME3 0x165667B19E3779F9ULL
+#define XXH64_PRIME4 0x85EBCA77C2B2AE63ULL
+#define XXH64_PRIME5 0x27D4EB2F165667C5ULL
+
+struct xxh64_state {
+    uint64_t total_len;
+    uint64_t acc[4];
+    unsigned char buffer[32];
+    size_t buffer_len;
+};
+
+uint64_t read_le64(const unsigned char *p)
+{
+    uint64_t val;
+    memcpy(&val, p, sizeof(val));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    val = __builtin_bswap64(val);
+#endif
+    return val;
+}
+uint32_t read_le32(const unsigned char *p)
+{
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    val = __builtin_bswap32(val);
+#endif
+    return val;
+}
+uint64_t rotl64(uint64_t x, unsigned r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+uint64_t xxh64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * XXH64_PRIME2;
+    return rotl64(acc, 31) * XXH64_PRIME1;
+}
+uint64_t xxh64_merge_round(uint64_t acc, uint64_t val)
+{
+    acc ^= xxh64_round(0, val);
+    return acc * XXH64_PRIME1 + XXH64_PRIME4;
+}
+
+void xxh64_init(struct xxh64_state *state)
+{
+    const uint64_t seed = 0;
+
+    state->total_len = 0;
+    state->acc[0] = seed + XXH64_PRIME1 + XXH64_PRIME2;
+    state->acc[1] = seed + XXH64_PRIME2;
+    state->acc[2] = seed;
+    state->acc[3] = seed - XXH64_PRIME1;
+    state->buffer_len = 0;
+}
+/**
+ * Consumes stripes of 32 bytes.
+ */
+void xxh64_stripes(uint64_t acc[4], const unsigned char *p, size_t nstripes)
+{
+    // Local copies let the compiler keep the 4 independent lanes in registers.
+    uint64_t acc0 = acc[0], acc1 = acc[1], acc2 = acc[2], acc3 = acc[3];
+    for (; nstripes != 0; --nstripes, p += 32) {
+        acc0 = xxh64_round(acc0, read_le64(p));
+        acc1 = xxh64_round(acc1, read_le64(p + 8));
+        acc2 = xxh64_round(acc2, read_le64(p + 16));
+        acc3 = xxh64_round(acc3, read_le64(p + 24));
+    }
+    acc[0] = acc0, acc[1] = acc1, acc[2] = acc2, acc[3] = acc3;
+}
+void xxh64_update(struct xxh64_state *state, const unsigned char *p, size_t len)
+{
+    state->total_len += len;
+
+    if (state->buffer_len != 0) {
+        size_t n = 32 - state->buffer_len;
+        if (n > len)
+            n = len;
+        memcpy(state->buffer + state->buffer_len, p, n);
+        state->buffer_len += n;
+        p += n;
+        len -= n;
+
+        if (state->buffer_len != 32)
+            return;
+        xxh64_stripes(state->acc, state->buffer, 1);
+        state->buffer_len = 0;
+    }
+
+    xxh64_stripes(state->acc, p, len / 32);
+    p += len / 32 * 32;
+    len %= 32;
+
+    memcpy(state->buffer, p, len);
+    state->buffer_len = len;
+}
+uint64_t xxh64_digest(const struct xxh64_state *state)
+{
+    const uint64_t *acc = state->acc;
+
+    uint64_t h;
+    if (state->total_len >= 32) {
+        h = rotl64(acc[0], 1) + rotl64(acc[1], 7) + rotl64(acc[2], 12) + rotl64(acc[3], 18);
+        for (size_t i = 0; i != 4; ++i)
+            h = xxh64_merge_round(h, acc[i]);
+    } else
+        h = acc[2] + XXH64_PRIME5;
+
+    h += state->total_len;
+
+    const unsigned char *p = state->buffer;
+    size_t len = state->buffer_len;
+    for (; len >= 8; p += 8, len -= 8) {
+        h ^= xxh64_round(0, read_le64(p));
+        h = rotl64(h, 27) * XXH64_PRIME1 + XXH64_PRIME4;
+    }
+    if (len >= 4) {
+        h ^= read_le32(p) * XXH64_PRIME1;
+        h = rotl64(h, 23) * XXH64_PRIME2 + XXH64_PRIME3;
+        p += 4;
+        len -= 4;
+    }
+    for (; len != 0; ++p, --len) {
+        h ^= *p * XXH64_PRIME5;
+        h = rotl64(h, 11) * XXH64_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= XXH64_PRIME2;
+    h ^= h >> 29;
+    h *= XXH64_PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+/**
+ * Tables for slicing-by-8, crc32c_table[0] is the classic byte-wise table.
+ */
+static uint32_t crc32c_table[8][256];
+static int crc32c_has_sse42;
+
+void crc32c_global_init(void)
+{
+    if (crc32c_table[0][1] != 0)
+        return;
+
+    for (uint32_t i = 0; i != 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j != 8; ++j)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        crc32c_table[0][i] = crc;
+    }
+    for (uint32_t i = 0; i != 256; ++i) {
+        for (int j = 1; j != 8; ++j) {
+            uint32_t crc = crc32c_table[j - 1][i];
+            crc32c_table[j][i] = (crc >> 8) ^ crc32c_table[0][crc & 0xff];
+        }
+    }
+
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    crc32c_has_sse42 = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+uint32_t crc32c_sw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t val = read_le64(p) ^ crc;
+        crc = crc32c_table[7][val & 0xff] ^
+              crc32c_table[6][(val >> 8) & 0xff] ^
+              crc32c_table[5][(val >> 16) & 0xff] ^
+              crc32c_table[4][(val >> 24) & 0xff] ^
+              crc32c_table[3][(val >> 32) & 0xff] ^
+              crc32c_table[2][(val >> 40) & 0xff] ^
+              crc32c_table[1][(val >> 48) & 0xff] ^
+              crc32c_table[0][val >> 56];
+    }
+    for (; len != 0; ++p, --len)
+        crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p) & 0xff];
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, const unsigned char *p, size_t len)
+{
+    uint64_t crc64 = crc;
+    for (; len >= 8; p += 8, len -= 8)
+        crc64 = __builtin_ia32_crc32di(crc64, read_le64(p));
+    crc = crc64;
+    for (; len != 0; ++p, --len)
+        crc = __builtin_ia32_crc32qi(crc, *p);
+    return crc;
+}
+#endif
+
+/**
+ * @param crc the previous return value, or 0 for the first call.
+ */
+uint32_t crc32c_update(uint32_t crc, const unsigned char *p, size_t len)
+{
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (crc32c_has_sse42)
+        return ~crc32c_hw(crc, p, len);
+#endif
+    return ~crc32c_sw(crc, p, len);
+}
+
+struct hash_state {
+    enum hash_algo algo;
+    union {
+        struct xxh64_state xxh64;
+        uint32_t crc32c;
+    };
+};
+
+void hash_global_init(void)
+{
+    crc32c_global_init();
+}
+void hash_init(struct hash_state *state, enum hash_algo algo)
+{
+    state->algo = algo;
+    if (algo == HASH_XXH64)
+        xxh64_init(&state->xxh64);
+    else
+        state->crc32c = 0;
+}
+void hash_update(struct hash_state *state, const void *p, size_t len)
+{
+    if (state->algo == HASH_XXH64)
+        xxh64_update(&state->xxh64, p, len);
+    else
+        state->crc32c = crc32c_update(state->crc32c, p, len);
+}
+/**
+ * Writes the digest in hex to out, which must be at least 17 bytes long.
+ */
+void hash_final_hex(const struct hash_state *state, char *out)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    uint64_t digest;
+    int ndigits;
+    if (state->algo == HASH_XXH64) {
+        digest = xxh64_digest(&state->xxh64);
+        ndigits = 16;
+    } else {
+        digest = state->crc32c;
+        ndigits = 8;
+    }
+
+    for (int i = ndigits - 1; i >= 0; --i, digest >>= 4)
+        out[i] = digits[digest & 0xf];
+    out[ndigits] = '\0';
+}
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef  __bash_loadables_lookup_H_
+# define __bash_loadables_lookup_H_
+
+/**
+ * Perfect hash tables mapping names to constants.
+ *
+ * Tables are specified in lookup_tables.def and generated into lookup_tables.h at build time
+ * by tools/gen_lookup, which shares the hash functions below, so this header must not depend
+ * on bash.
+ *
+ * A table has nslots slots and ndisps displacements: a name is first hashed into a
+ * displacement, which is then mixed with the hash of the name to get the only slot it
+ * can be in.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct lookup_table {
+    /**
+     * All names separated by '\0', starts with an empty name used by empty slots.
+     */
+    const char *names;
+    /**
+     * Offsets of the name in each slot into names.
+     */
+    const uint16_t *offsets;
+    const uint16_t *disps;
+    uint32_t nslots;
+    uint32_t ndisps;
+};
+
+/**
+ * Case-insensitive FNV-1a.
+ */
+uint32_t lookup_hash(const char *name, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i != len; ++i)
+        hash = (hash ^ (unsigned char) (name[i] | 0x20)) * 16777619u;
+    return hash;
+}
+/**
+ * Maps x to [0, n) without division.
+ */
+uint32_t lookup_reduce(uint32_t x, uint32_t n)
+{
+    return ((uint64_t) x * n) >> 32;
+}
+uint32_t lookup_slot(uint32_t hash, uint16_t disp, uint32_t nslots)
+{
+    // Finalizer of murmur3
+    uint32_t x = hash ^ (disp * 0x9E3779B9u);
+    x ^= x >> 16;
+    x *= 0x85EBCA6Bu;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35u;
+    x ^= x >> 16;
+    return lookup_reduce(x, nslots);
+}
+
+#endif
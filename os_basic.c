@@ -9,11 +9,13 @@
 #define _XOPEN_SOURCE 700 // For fchmod
 
 #include "utilities.h"
+#include "bash/execute_cmd.h"
 
 #include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -43,6 +45,9 @@
 #include <netinet/ip.h> /* superset of previous */
 #include <arpa/inet.h>
 
+#define LOOKUP_TABLES_OS_BASIC
+#include "lookup_tables.h"
+
 #include <sched.h>
 
 #include <err.h>
@@ -83,7 +88,122 @@ void* get_pg_impl(void* (*get_f)(const char*), const char *name,
 
     return ret;
 }
+/**
+ * Cache of name to uid/gid lookup done by getpwnam/getgrnam, so that repeated fchown or
+ * set_supplementary_groups do not hit NSS (which might be sssd/LDAP) on every call.
+ *
+ * The whole cache is dropped once the mtime of db changes, or by idcache_flush.
+ */
+struct idcache_entry {
+    char *name; // NULL if the slot is empty
+    uint32_t id;
+};
+struct idcache {
+    const char *db;
+    struct timespec mtime;
+    size_t size;
+    size_t capacity; // Always power of 2 or 0
+    struct idcache_entry *entries;
+};
+static struct idcache user_idcache = { .db = "/etc/passwd" };
+static struct idcache group_idcache = { .db = "/etc/group" };
+
+void idcache_flush(struct idcache *cache)
+{
+    for (size_t i = 0; i != cache->capacity; ++i)
+        (free)(cache->entries[i].name);
+    (free)(cache->entries);
+
+    cache->size = 0;
+    cache->capacity = 0;
+    cache->entries = NULL;
+}
+/**
+ * Flush cache if its db is modified since last call.
+ */
+void idcache_validate(struct idcache *cache)
+{
+    struct stat statbuf;
+    if (stat(cache->db, &statbuf) == -1)
+        statbuf.st_mtim = (struct timespec){ 0, 0 };
+
+    if (statbuf.st_mtim.tv_sec != cache->mtime.tv_sec || 
+        statbuf.st_mtim.tv_nsec != cache->mtime.tv_nsec) {
+        idcache_flush(cache);
+        cache->mtime = statbuf.st_mtim;
+    }
+}
+/**
+ * @return slot of name in cache, which might be empty.
+ */
+struct idcache_entry* idcache_find(const struct idcache *cache, const char *name)
+{
+    size_t mask = cache->capacity - 1;
+    size_t i = lookup_hash(name, strlen(name)) & mask;
+    for (; cache->entries[i].name != NULL; i = (i + 1) & mask) {
+        if (strcmp(cache->entries[i].name, name) == 0)
+            break;
+    }
+    return &cache->entries[i];
+}
+/**
+ * @return 0 if name is found and *id is set, -1 otherwise.
+ */
+int idcache_get(const struct idcache *cache, const char *name, uint32_t *id)
+{
+    if (cache->size == 0)
+        return -1;
+
+    struct idcache_entry *entry = idcache_find(cache, name);
+    if (entry->name == NULL)
+        return -1;
+
+    *id = entry->id;
+    return 0;
+}
+/**
+ * Failure to insert is ignored since the cache is only an optimization.
+ */
+void idcache_put(struct idcache *cache, const char *name, uint32_t id)
+{
+    if (2 * (cache->size + 1) > cache->capacity) {
+        struct idcache old = *cache;
+
+        cache->capacity = old.capacity == 0 ? 16 : old.capacity * 2;
+        cache->entries = calloc(cache->capacity, sizeof(struct idcache_entry));
+        if (cache->entries == NULL) {
+            *cache = old;
+            return;
+        }
+
+        for (size_t i = 0; i != old.capacity; ++i) {
+            if (old.entries[i].name != NULL)
+                *idcache_find(cache, old.entries[i].name) = old.entries[i];
+        }
+        (free)(old.entries);
+    }
+
+    struct idcache_entry *entry = idcache_find(cache, name);
+    if (entry->name == NULL) {
+        entry->name = strdup(name);
+        if (entry->name == NULL)
+            return;
+        ++cache->size;
+    }
+    entry->id = id;
+}
+
+/**
+ * Called when `os_basic' is disabled.
+ */
+PUBLIC void os_basic_builtin_unload(char *name)
+{
+    idcache_flush(&user_idcache);
+    idcache_flush(&group_idcache);
+}
+
 int parse_id_impl(uint32_t *id, const char *name, void* (*get_f)(const char*), size_t offset, 
+                  struct idcache *cache,
                   /* meta info for printing on error */
                   const char *function_name, const char *name_type, const char *id_type)
 {
@@ -94,11 +214,16 @@ int parse_id_impl(uint32_t *id, const char *name, void* (*get_f)(const char*), s
 
     int result = str2uint32(name, id);
     if (result == -1) {
+        idcache_validate(cache);
+        if (idcache_get(cache, name, id) == 0)
+            return 0;
+
         char *ret = get_pg_impl(get_f, name, function_name, name_type);
 
-        if (ret)
+        if (ret) {
             *id = *((unsigned*) (ret + offset));
-        else
+            idcache_put(cache, name, *id);
+        } else
             return -1;
     } else if (result == -2) {
         fprintf(stderr, "Input %s is too large!", id_type);
@@ -107,8 +232,8 @@ int parse_id_impl(uint32_t *id, const char *name, void* (*get_f)(const char*), s
 
     return 0;
 }
-#define parse_id(id, name, get_f, offset) \
-    parse_id_impl(id, name, (void* (*)(const char*)) get_f, offset, # get_f, # name, # id)
+#define parse_id(id, name, get_f, offset, cache) \
+    parse_id_impl(id, name, (void* (*)(const char*)) get_f, offset, cache, # get_f, # name, # id)
 
 /**
  * @param uid != NULL, only modified on success.
@@ -120,7 +245,7 @@ int parse_user(uid_t *uid, const char *user)
     _Static_assert(sizeof(uid_t) == sizeof(uint32_t), "not supported!");
     _Static_assert((uid_t) -1 > 0, "not supported!");
 
-    return parse_id(uid, user, getpwnam, offsetof(struct passwd, pw_uid));
+    return parse_id(uid, user, getpwnam, offsetof(struct passwd, pw_uid), &user_idcache);
 }
 
 /**
@@ -133,7 +258,7 @@ int parse_group(gid_t *gid, const char *group)
     _Static_assert(sizeof(gid_t) == sizeof(uint32_t), "not supported!");
     _Static_assert((gid_t) -1 > 0, "not supported!");
 
-    return parse_id(gid, group, getgrnam, offsetof(struct group, gr_gid));
+    return parse_id(gid, group, getgrnam, offsetof(struct group, gr_gid), &group_idcache);
 }
 
 /**
@@ -226,6 +351,254 @@ PUBLIC struct builtin create_memfd_struct = {
     0                           /* reserved for internal use */
 };
 
+int memfd_from_builtin(WORD_LIST *list)
+{
+    unsigned flags = PARSE_FLAG(&list, "Cs", MFD_CLOEXEC, MFD_ALLOW_SEALING);
+
+    const char *argv[2];
+    if (to_argv(list, 2, argv) == -1)
+        return (EX_USAGE);
+
+    const char *value = get_string_value(argv[0]);
+    if (value == NULL) {
+        warnx("memfd_from: %s: variable is unset", argv[0]);
+        return (EXECUTION_FAILURE);
+    }
+
+    int fd = memfd_create(argv[0], flags);
+    if (fd == -1) {
+        warn("memfd_create failed");
+        if (errno == EFAULT || errno == EINVAL)
+            return 100;
+        else
+            return 1;
+    }
+
+    // Write the whole value in one go, so that the child never sees a partial file.
+    if (write_all(fd, value, strlen(value), "memfd_from") == -1)
+        goto fail;
+
+    if (flags & MFD_ALLOW_SEALING) {
+        int seals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL;
+        if (fcntl(fd, F_ADD_SEALS, seals) == -1) {
+            warn("memfd_from: fcntl(F_ADD_SEALS) failed");
+            goto fail;
+        }
+    }
+
+    if (lseek(fd, 0, SEEK_SET) == -1) {
+        warn("memfd_from: lseek failed");
+        goto fail;
+    }
+
+    bind_var_to_int((char*) argv[1], fd);
+
+    return (EXECUTION_SUCCESS);
+
+fail:
+    close(fd);
+    return (EXECUTION_FAILURE);
+}
+PUBLIC struct builtin memfd_from_struct = {
+    "memfd_from",               /* builtin name */
+    memfd_from_builtin,         /* function implementing the builtin */
+    BUILTIN_ENABLED,            /* initial flags for builtin */
+    (char*[]){
+        "Create an anonymous file in RAM like create_memfd, write the value of $VAR to it,",
+        "rewind it and store its fd in variable $FD_VAR.",
+        "",
+        "It can then be used as stdin of commands, e.g. 'cmd <&$FD_VAR', without temporary",
+        "files on disk or pipes that could fill up.",
+        "",
+        "Pass -C to enable CLOEXEC.",
+        "Pass -s to seal the file, so that it can no longer be modified.",
+        "",
+        "On error:",
+        "    On resource exhaustion, return 1.",
+        "    On invalid name, return 100.",
+        (char*) NULL
+    },                          /* array of long documentation strings. */
+    "memfd_from [-Cs] VAR FD_VAR", /* usage synopsis; becomes short_doc */
+    0                           /* reserved for internal use */
+};
+
+struct capture_ctx {
+    int memfd;
+    int nfds;           // number of fds starting from 1 redirected to memfd
+    int saved_fds[2];   // -1 if the fd was closed
+};
+
+/**
+ * Restores the redirected fds, closes memfd and frees ctx.
+ *
+ * It is registered as an unwind-protect, so that it also runs if the function
+ * longjmps out of capture, e.g. on errexit or SIGINT.
+ */
+void capture_restore(void *arg)
+{
+    struct capture_ctx *ctx = arg;
+
+    fflush(stdout);
+    fflush(stderr);
+
+    for (int i = 0; i != ctx->nfds; ++i) {
+        int fd = i + 1;
+        if (ctx->saved_fds[i] == -1)
+            close(fd);
+        else {
+            dup2(ctx->saved_fds[i], fd);
+            close(ctx->saved_fds[i]);
+        }
+    }
+    close(ctx->memfd);
+    (free)(ctx);
+}
+/**
+ * @return 0 on success, -1 on failure with errno set.
+ */
+int capture_redirect(struct capture_ctx *ctx, int nfds)
+{
+    fflush(stdout);
+    fflush(stderr);
+
+    for (; ctx->nfds != nfds; ++ctx->nfds) {
+        int fd = ctx->nfds + 1;
+
+        // Use fds >= 10 like bash does, to stay out of the way of user redirections.
+        int saved = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+        if (saved == -1 && errno != EBADF)
+            return -1;
+        ctx->saved_fds[ctx->nfds] = saved;
+
+        if (dup2(ctx->memfd, fd) == -1) {
+            ++ctx->nfds;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+/**
+ * @return content of memfd with trailing newlines removed like command substitution,
+ *         or NULL on failure with errno set.
+ */
+char* capture_read(int memfd)
+{
+    struct stat statbuf;
+    if (fstat(memfd, &statbuf) == -1)
+        return NULL;
+
+    size_t size = statbuf.st_size;
+    char *output = malloc(size + 1);
+    if (output == NULL)
+        return NULL;
+
+    for (size_t len = 0; len != size; ) {
+        ssize_t cnt = pread(memfd, output + len, size - len, len);
+        if (cnt == -1 && errno == EINTR)
+            continue;
+        if (cnt <= 0) {
+            if (cnt == 0)
+                errno = EIO;
+            (free)(output);
+            return NULL;
+        }
+        len += cnt;
+    }
+
+    while (size != 0 && output[size - 1] == '\n')
+        --size;
+    output[size] = '\0';
+
+    return output;
+}
+
+int capture_builtin(WORD_LIST *list)
+{
+    int nfds = 1 + PARSE_FLAG(&list, "e", 1);
+
+    if (list == NULL || list->next == NULL) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    const char *var = list->word->word;
+    WORD_LIST *command = list->next;
+
+    SHELL_VAR *func = find_function(command->word->word);
+    if (func == NULL) {
+        warnx("capture: %s: function not found", command->word->word);
+        return (EXECUTION_FAILURE);
+    }
+
+    struct capture_ctx *ctx = malloc(sizeof(struct capture_ctx));
+    if (ctx == NULL) {
+        warn("capture: malloc failed");
+        return (EXECUTION_FAILURE);
+    }
+    ctx->nfds = 0;
+
+    ctx->memfd = memfd_create("capture", MFD_CLOEXEC);
+    if (ctx->memfd == -1) {
+        warn("capture: memfd_create failed");
+        (free)(ctx);
+        return (EXECUTION_FAILURE);
+    }
+
+    if (capture_redirect(ctx, nfds) == -1) {
+        int saved_errno = errno;
+        capture_restore(ctx);
+        errno = saved_errno;
+        warn("capture: failed to redirect fd");
+        return (EXECUTION_FAILURE);
+    }
+
+    begin_unwind_frame("capture");
+    add_unwind_protect(capture_restore, ctx);
+
+    int status = execute_shell_function(func, command);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    char *output = capture_read(ctx->memfd);
+    int saved_errno = errno;
+
+    run_unwind_frame("capture");
+
+    if (output == NULL) {
+        errno = saved_errno;
+        warn("capture: failed to read output");
+        return (EXECUTION_FAILURE);
+    }
+
+    bind_variable(var, output, 0);
+    (free)(output);
+
+    return status;
+}
+PUBLIC struct builtin capture_struct = {
+    "capture",                  /* builtin name */
+    capture_builtin,            /* function implementing the builtin */
+    BUILTIN_ENABLED,            /* initial flags for builtin */
+    (char*[]){
+        "Run shell function func with args in the current shell, with its stdout redirected",
+        "to a memfd, then store the output in variable $VAR.",
+        "",
+        "It behaves like 'VAR=$(func args ...)', but does not fork, so the function can",
+        "modify variables of the current shell.",
+        "Trailing newlines are removed like in command substitution, and the output is",
+        "truncated at the first NUL byte.",
+        "",
+        "Pass -e to capture stderr as well.",
+        "",
+        "Return the exit status of func, or 1 if the output cannot be captured.",
+        (char*) NULL
+    },                          /* array of long documentation strings. */
+    "capture [-e] VAR func [args ...]", /* usage synopsis; becomes short_doc */
+    0                           /* reserved for internal use */
+};
+
 int create_tmpfile_builtin(WORD_LIST *list)
 {
     int flags = O_TMPFILE | PARSE_FLAG(&list, "CE", O_CLOEXEC, O_EXCL);
@@ -235,14 +608,12 @@ int create_tmpfile_builtin(WORD_LIST *list)
     if (opt_argc == -1)
         return (EX_USAGE);
 
-    if (strcasecmp(argv[2], "rw") == 0)
-        flags |= O_RDWR;
-    else if (strcasecmp(argv[2], "w") == 0)
-        flags |= O_WRONLY;
-    else {
+    int mode_flag;
+    if (LOOKUP(open_mode, argv[2], &mode_flag) == -1) {
         builtin_usage();
         return (EX_USAGE);
     }
+    flags |= mode_flag;
 
     mode_t mode;
     if (opt_argc == 1) {
@@ -316,13 +687,7 @@ int lseek_builtin(WORD_LIST *list)
     }
 
     int whence;
-    if (strcasecmp(argv[2], "SEEK_SET") == 0)
-        whence = SEEK_SET;
-    else if (strcasecmp(argv[2], "SEEK_CUR") == 0)
-        whence = SEEK_CUR;
-    else if (strcasecmp(argv[2], "SEEK_END") == 0)
-        whence = SEEK_CUR;
-    else {
+    if (LOOKUP(seek_whence, argv[2], &whence) == -1) {
         builtin_usage();
         return (EX_USAGE);
     }
@@ -581,6 +946,223 @@ PUBLIC struct builtin fchown_struct = {
     0                           /* reserved for internal use */
 };
 
+#define FSTAT_MANY_MAX_FIELDS 12
+
+struct fstat_many_field {
+    unsigned mask;
+    HASH_TABLE *hash;
+};
+
+/**
+ * @return -1 on error, otherwise number of fields read into fields.
+ */
+int parse_statx_fields(const char *arg, const char *prefix, struct fstat_many_field *fields)
+{
+    int nfields = 0;
+    for (const char *p = arg; *p != '\0'; ) {
+        size_t len = strcspn(p, ",");
+
+        unsigned mask;
+        if (LOOKUP_N(statx_field, p, len, &mask) == -1) {
+            warnx("fstat_many: Invalid field %.*s", (int) len, p);
+            return -1;
+        }
+        if (nfields == FSTAT_MANY_MAX_FIELDS) {
+            warnx("fstat_many: Too many fields");
+            return -1;
+        }
+
+        size_t prefix_len = strlen(prefix);
+        char varname[prefix_len + 1 + len + 1];
+        memcpy(varname, prefix, prefix_len);
+        varname[prefix_len] = '_';
+        for (size_t i = 0; i != len; ++i)
+            varname[prefix_len + 1 + i] = tolower((unsigned char) p[i]);
+        varname[prefix_len + 1 + len] = '\0';
+
+        fields[nfields].mask = mask;
+        fields[nfields].hash = assoc_cell(make_new_assoc_variable(varname));
+        ++nfields;
+
+        p += len;
+        if (*p == ',')
+            ++p;
+    }
+
+    return nfields;
+}
+
+/**
+ * @param buffer must be at least sizeof(STR(INT64_MIN)) long.
+ * @return string representation of field in statxbuf stored in buffer.
+ */
+char* format_statx_field(const struct statx *statxbuf, unsigned mask, char *buffer)
+{
+    char *end = buffer + sizeof(STR(INT64_MIN));
+
+    switch (mask) {
+        case STATX_TYPE:
+            switch (statxbuf->stx_mode & S_IFMT) {
+                case S_IFREG:  buffer[0] = 'f'; break;
+                case S_IFDIR:  buffer[0] = 'd'; break;
+                case S_IFLNK:  buffer[0] = 'l'; break;
+                case S_IFIFO:  buffer[0] = 'p'; break;
+                case S_IFSOCK: buffer[0] = 's'; break;
+                case S_IFCHR:  buffer[0] = 'c'; break;
+                case S_IFBLK:  buffer[0] = 'b'; break;
+                default:       buffer[0] = '?';
+            }
+            buffer[1] = '\0';
+            return buffer;
+
+        case STATX_MODE:
+            snprintf(buffer, end - buffer, "%o", statxbuf->stx_mode & 07777);
+            return buffer;
+
+        case STATX_NLINK:
+            return uint2str(statxbuf->stx_nlink, end);
+        case STATX_UID:
+            return uint2str(statxbuf->stx_uid, end);
+        case STATX_GID:
+            return uint2str(statxbuf->stx_gid, end);
+        case STATX_ATIME:
+            return int2str(statxbuf->stx_atime.tv_sec, end);
+        case STATX_MTIME:
+            return int2str(statxbuf->stx_mtime.tv_sec, end);
+        case STATX_CTIME:
+            return int2str(statxbuf->stx_ctime.tv_sec, end);
+        case STATX_INO:
+            return uint2str(statxbuf->stx_ino, end);
+        case STATX_SIZE:
+            return uint2str(statxbuf->stx_size, end);
+        case STATX_BLOCKS:
+            return uint2str(statxbuf->stx_blocks, end);
+        case STATX_BTIME:
+            return int2str(statxbuf->stx_btime.tv_sec, end);
+        default:
+            return NULL;
+    }
+}
+
+int fstat_many_builtin(WORD_LIST *list)
+{
+    int dirfd = AT_FDCWD;
+    int flags = AT_SYMLINK_NOFOLLOW;
+    int is_fd = 0;
+    const char *fields_arg = "type,mode,size,mtime";
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "LFd:f:")) != -1; ) {
+        switch (opt) {
+        case 'L':
+            flags &= ~AT_SYMLINK_NOFOLLOW;
+            break;
+
+        case 'F':
+            is_fd = 1;
+            break;
+
+        case 'd':
+            if (str2fd(list_optarg, &dirfd) == -1)
+                return (EX_USAGE);
+            break;
+
+        case 'f':
+            fields_arg = list_optarg;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    int argc = list_length(list);
+    if (argc < 2) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    // The last arg is prefix
+    WORD_LIST *prefix = list;
+    for (int i = 0; i != argc - 1; ++i)
+        prefix = prefix->next;
+
+    struct fstat_many_field fields[FSTAT_MANY_MAX_FIELDS];
+    int nfields = parse_statx_fields(fields_arg, prefix->word->word, fields);
+    if (nfields == -1)
+        return (EX_USAGE);
+
+    unsigned mask = 0;
+    for (int i = 0; i != nfields; ++i)
+        mask |= fields[i].mask;
+
+    int result = EXECUTION_SUCCESS;
+
+    for (; list != prefix; list = list->next) {
+        const char *file = list->word->word;
+
+        int fd = dirfd;
+        const char *path = file;
+        int statx_flags = flags;
+        if (is_fd) {
+            if (str2fd(file, &fd) == -1) {
+                result = EXECUTION_FAILURE;
+                continue;
+            }
+            path = "";
+            statx_flags |= AT_EMPTY_PATH;
+        }
+
+        struct statx statxbuf;
+        if (statx(fd, path, statx_flags, mask, &statxbuf) == -1) {
+            warn("fstat_many: statx %s failed", file);
+            result = EXECUTION_FAILURE;
+            continue;
+        }
+
+        char buffer[sizeof(STR(INT64_MIN))];
+        for (int i = 0; i != nfields; ++i) {
+            // Fields not supported by the filesystem are left unset
+            if ((statxbuf.stx_mask & fields[i].mask) == 0)
+                continue;
+            assoc_insert(fields[i].hash, savestring(file), 
+                         format_statx_field(&statxbuf, fields[i].mask, buffer));
+        }
+    }
+
+    return result;
+}
+PUBLIC struct builtin fstat_many_struct = {
+    "fstat_many",               /* builtin name */
+    fstat_many_builtin,         /* function implementing the builtin */
+    BUILTIN_ENABLED,            /* initial flags for builtin */
+    (char*[]){
+        "fstat_many calls statx on each of files and stores the fields requested in",
+        "associative arrays named prefix_field, indexed by the file as passed.",
+        "",
+        "'-f' sets fields in the form of comma separated list of type, mode, nlink, uid, gid,",
+        "atime, mtime, ctime, ino, size, blocks and btime, default to type,mode,size,mtime.",
+        "Only these fields are requested from the kernel.",
+        "",
+        "type is one of f, d, l, p, s, c, b as in 'find -type', mode is in octal and",
+        "times are in seconds since epoch.",
+        "Fields that are not supported by the filesystem are left unset.",
+        "",
+        "If '-L' is passed, symlinks are followed.",
+        "If '-d' is passed, relative paths are resolved relative to dirfd.",
+        "If '-F' is passed, files are fds instead of paths.",
+        "",
+        "If a file cannot be stat-ed, fstat_many continues with the rest of files and returns 1.",
+        (char*) NULL
+    },                          /* array of long documentation strings. */
+    "fstat_many [-LF] [-d <int> dirfd] [-f fields] files... prefix",      /* usage synopsis; becomes short_doc */
+    0                           /* reserved for internal use */
+};
+
 int getresid_impl(WORD_LIST *list, int (*getter)(uint32_t*, uint32_t*, uint32_t*))
 {
     if (check_no_options(&list) == -1)
@@ -741,18 +1323,10 @@ int get_supplementary_groups_builtin(WORD_LIST *list)
 
         result = getgroups(ngids, gids);
         if (result == ngids) {
-            SHELL_VAR *var = make_new_array_variable((char*) varname);
-            ARRAY *array = array_cell(var);
-
-            _Static_assert(sizeof(gid_t) == sizeof(uint32_t), "not supported!");
+            _Static_assert(sizeof(gid_t) == sizeof(unsigned), "not supported!");
             _Static_assert((gid_t) -1 > 0, "not supported!");
 
-            char buffer[sizeof(STR(UINT_MAX))];
-            for (int i = 0; i != ngids; ++i) {
-                snprintf(buffer, sizeof(buffer), "%zu", (size_t) gids[i]);
-
-                array_insert(array, i, buffer);
-            }
+            bind_uint_array(varname, gids, ngids);
         }
 
         END_VLA(gids);
@@ -844,11 +1418,7 @@ int create_unixsocketpair_builtin(WORD_LIST *list)
         return (EX_USAGE);
 
     int type;
-    if (strcasecmp(argv[0], "stream") == 0)
-        type = SOCK_STREAM;
-    else if (strcasecmp(argv[0], "dgram") == 0)
-        type = SOCK_DGRAM;
-    else {
+    if (LOOKUP(socketpair_type, argv[0], &type) == -1) {
         builtin_usage();
         return (EX_USAGE);
     }
@@ -1004,6 +1574,268 @@ PUBLIC struct builtin fdecho_struct = {
     0                             /* reserved for internal use */
 };
 
+#define FDSCAN_BUFSIZE (256 * 1024)
+
+enum fdscan_mode {
+    FDSCAN_COUNT,
+    FDSCAN_FIND,
+    FDSCAN_LINES,
+};
+struct fdscan_state {
+    enum fdscan_mode mode;
+    const char *needle;
+    size_t needle_len;
+
+    uintmax_t count;    // newlines counted by FDSCAN_COUNT
+    ARRAY *array;       // results of FDSCAN_FIND and FDSCAN_LINES
+    arrayind_t nresults;
+
+    uintmax_t base;     // offset of the data passed to fdscan_buffer since the start of scan
+
+    char *line;         // NUL-terminated copy of the line matched for FDSCAN_LINES
+    size_t line_cap;
+};
+
+/**
+ * Count '\n' in buffer 8 bytes at a time.
+ */
+uintmax_t count_newlines(const char *buffer, size_t len)
+{
+    const uint64_t ones = 0x0101010101010101ULL;
+    const uint64_t low7 = 0x7f7f7f7f7f7f7f7fULL;
+
+    uintmax_t cnt = 0;
+    for (; len >= 8; buffer += 8, len -= 8) {
+        uint64_t word;
+        memcpy(&word, buffer, sizeof(word));
+        word ^= '\n' * ones;
+        // The high bit of each byte is set iff the byte is zero, without carry between bytes.
+        cnt += __builtin_popcountll(~(((word & low7) + low7) | word | low7));
+    }
+    for (; len != 0; ++buffer, --len)
+        cnt += *buffer == '\n';
+
+    return cnt;
+}
+
+/**
+ * @return -1 on error, 0 otherwise.
+ */
+int fdscan_add_line(struct fdscan_state *state, const char *line, size_t len)
+{
+    if (len + 1 > state->line_cap) {
+        size_t cap = state->line_cap == 0 ? 256 : state->line_cap;
+        while (len + 1 > cap)
+            cap *= 2;
+
+        char *buffer = realloc(state->line, cap);
+        if (buffer == NULL) {
+            warn("fdscan: realloc failed");
+            return -1;
+        }
+        state->line = buffer;
+        state->line_cap = cap;
+    }
+
+    memcpy(state->line, line, len);
+    state->line[len] = '\0';
+    array_append(state->array, state->nresults++, state->line);
+
+    return 0;
+}
+/**
+ * @param eof whether buffer is the end of data.
+ * @return number of bytes of buffer consumed, -1 on error.
+ *         The rest must be passed again with more data appended.
+ */
+ssize_t fdscan_buffer(struct fdscan_state *state, const char *buffer, size_t len, int eof)
+{
+    const char *end = buffer + len;
+    const char *p = buffer;
+
+    switch (state->mode) {
+        case FDSCAN_COUNT:
+            state->count += count_newlines(buffer, len);
+            return len;
+
+        case FDSCAN_FIND:
+        {
+            char digits[sizeof(STR(UINTMAX_MAX))];
+            for (const char *match; (match = memmem(p, end - p, state->needle, state->needle_len)) != NULL; ) {
+                uintmax_t off = state->base + (match - buffer);
+                array_append(state->array, state->nresults++, uint2str(off, digits + sizeof(digits)));
+                p = match + state->needle_len;
+            }
+
+            if (eof)
+                return len;
+            // Keep the tail that might be the start of a match
+            size_t keep = state->needle_len - 1;
+            size_t consumed = len > keep ? len - keep : 0;
+            return consumed > p - buffer ? consumed : p - buffer;
+        }
+
+        case FDSCAN_LINES:
+        {
+            for (const char *newline; (newline = memchr(p, '\n', end - p)) != NULL; p = newline + 1) {
+                if (memmem(p, newline - p, state->needle, state->needle_len) != NULL) {
+                    if (fdscan_add_line(state, p, newline - p) == -1)
+                        return -1;
+                }
+            }
+
+            if (!eof)
+                return p - buffer;
+
+            // The last line without '\n'
+            if (p != end && memmem(p, end - p, state->needle, state->needle_len) != NULL) {
+                if (fdscan_add_line(state, p, end - p) == -1)
+                    return -1;
+            }
+            return len;
+        }
+    }
+
+    return len;
+}
+/**
+ * @return -1 on error, 0 otherwise.
+ */
+int fdscan_read(int fd, struct fdscan_state *state)
+{
+    size_t cap = FDSCAN_BUFSIZE;
+    char *buffer = malloc(cap);
+    if (buffer == NULL) {
+        warn("fdscan: malloc failed");
+        return -1;
+    }
+
+    int ret = 0;
+    size_t len = 0;
+    for (int eof = 0; !eof; ) {
+        if (len == cap) {
+            // A line longer than buffer
+            char *new_buffer = realloc(buffer, cap * 2);
+            if (new_buffer == NULL) {
+                warn("fdscan: realloc failed");
+                ret = -1;
+                break;
+            }
+            buffer = new_buffer;
+            cap *= 2;
+        }
+
+        ssize_t cnt = read(fd, buffer + len, cap - len);
+        if (cnt == -1) {
+            if (errno == EINTR)
+                continue;
+            warn("fdscan: read failed");
+            ret = -1;
+            break;
+        }
+        eof = cnt == 0;
+        len += cnt;
+
+        ssize_t consumed = fdscan_buffer(state, buffer, len, eof);
+        if (consumed == -1) {
+            ret = -1;
+            break;
+        }
+        state->base += consumed;
+        len -= consumed;
+        memmove(buffer, buffer + consumed, len);
+    }
+
+    (free)(buffer);
+    return ret;
+}
+
+int fdscan_builtin(WORD_LIST *list)
+{
+    struct fdscan_state state = { .mode = FDSCAN_COUNT };
+    int nmodes = 0;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "cf:l:")) != -1; ) {
+        switch (opt) {
+        case 'c':
+            state.mode = FDSCAN_COUNT;
+            ++nmodes;
+            break;
+
+        case 'f':
+        case 'l':
+            state.mode = opt == 'f' ? FDSCAN_FIND : FDSCAN_LINES;
+            state.needle = list_optarg;
+            state.needle_len = strlen(list_optarg);
+            ++nmodes;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    if (nmodes != 1 || (state.needle != NULL && state.needle_len == 0)) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    const char *argv[2];
+    int opt_argc = to_argv_opt(list, 1, state.mode == FDSCAN_COUNT, argv);
+    if (opt_argc == -1)
+        return (EX_USAGE);
+    if (state.mode != FDSCAN_COUNT) {
+        if (opt_argc == 0) {
+            builtin_usage();
+            return (EX_USAGE);
+        }
+        state.array = array_cell(make_new_array_variable((char*) argv[1]));
+    }
+
+    int fd;
+    if (str2fd(argv[0], &fd) == -1)
+        return (EX_USAGE);
+
+    int ret = fdscan_read(fd, &state);
+    (free)(state.line);
+
+    if (ret == -1)
+        return (EXECUTION_FAILURE);
+
+    if (state.mode == FDSCAN_COUNT) {
+        char buffer[sizeof(STR(UINTMAX_MAX))];
+        char *cnt = uint2str(state.count, buffer + sizeof(buffer));
+        if (opt_argc == 1)
+            bind_variable(argv[1], cnt, 0);
+        else
+            puts(cnt);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin fdscan_struct = {
+    "fdscan",       /* builtin name */
+    fdscan_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "fdscan reads fd until EOF and",
+        " - '-c': counts newlines like 'wc -l', which is stored in var or printed to stdout.",
+        " - '-f needle': stores byte offsets of non-overlapping needle in var as array.",
+        " - '-l needle': stores lines (without '\\n') containing needle in var as array,",
+        "   like 'grep -F'.",
+        "",
+        "Offsets are relative to the offset of fd when fdscan is called.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "fdscan -c <int> fd [var] / fdscan -f/-l needle <int> fd var",      /* usage synopsis; becomes short_doc */
+    0                             /* reserved for internal use */
+};
+
 int sendfds_builtin_impl(int socketfd, int fd_cnt, const struct msghdr *msg, int flags, WORD_LIST *list)
 {
     struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg);
@@ -1128,13 +1960,10 @@ int recvfds_builtin_impl(int socketfd, struct msghdr *msg, int flags, char *varn
     int *cmsg_data = (int*) CMSG_DATA(cmsg);
 
     int fd;
+    char buffer[sizeof(STR(INT_MIN))];
     for (size_t i = 0; i != nfd_readin; ++i) {
         memcpy(&fd, cmsg_data + i, sizeof(int));
-
-        char buffer[sizeof(STR(INT_MAX))];
-        snprintf(buffer, sizeof(buffer), "%d", fd);
-
-        array_insert(array, i, buffer);
+        array_append(array, i, int2str(fd, buffer + sizeof(buffer)));
     }
 
     return (EXECUTION_SUCCESS);
@@ -1342,6 +2171,81 @@ PUBLIC struct builtin has_supplementary_group_member_struct = {
     0                             /* reserved for internal use */
 };
 
+int idcache_flush_builtin(WORD_LIST *list)
+{
+    if (check_no_options(&list) == -1)
+        return (EX_USAGE);
+
+    if (to_argv(list, 0, NULL) == -1)
+        return (EX_USAGE);
+
+    idcache_flush(&user_idcache);
+    idcache_flush(&group_idcache);
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin idcache_flush_struct = {
+    "idcache_flush",       /* builtin name */
+    idcache_flush_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "Drop the cached result of username/groupname to uid/gid lookup.",
+        "",
+        "The cache is also dropped automatically when /etc/passwd or /etc/group is modified,",
+        "but not when the user/group is changed in other NSS backends.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "idcache_flush",      /* usage synopsis; becomes short_doc */
+    0                             /* reserved for internal use */
+};
+
+int resolve_ids_builtin_impl(WORD_LIST *list, int ids_len, uint32_t *ids, int is_group)
+{
+    for (int i = 0; i != ids_len; ++i, list = list->next) {
+        int result = is_group ? parse_group(ids + i, list->word->word) : 
+                                parse_user(ids + i, list->word->word);
+        if (result == -1)
+            return (EXECUTION_FAILURE);
+    }
+
+    _Static_assert(sizeof(uint32_t) == sizeof(unsigned), "not supported!");
+    bind_uint_array(list->word->word, ids, ids_len);
+
+    return (EXECUTION_SUCCESS);
+}
+int resolve_ids_builtin(WORD_LIST *list)
+{
+    int is_group = PARSE_FLAG(&list, "g", 1);
+
+    int argc = list_length(list);
+    if (argc < 1) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    int ids_len = argc - 1;
+
+    uint32_t *ids;
+    START_VLA(uint32_t, ids_len, ids);
+    int result = resolve_ids_builtin_impl(list, ids_len, ids, is_group);
+    END_VLA(ids);
+
+    return result;
+}
+PUBLIC struct builtin resolve_ids_struct = {
+    "resolve_ids",       /* builtin name */
+    resolve_ids_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "Resolve usernames/uids (or groupnames/gids if '-g' is passed) into arr in the form of array.",
+        "",
+        "Results of username/groupname lookup are cached, see idcache_flush.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "resolve_ids [-g] [names...] arr",      /* usage synopsis; becomes short_doc */
+    0                             /* reserved for internal use */
+};
+
 int create_socket_builtin(WORD_LIST *list)
 {
     int flags = PARSE_FLAG(&list, "NC", SOCK_NONBLOCK, SOCK_CLOEXEC);
@@ -1351,25 +2255,13 @@ int create_socket_builtin(WORD_LIST *list)
         return (EX_USAGE);
 
     int domain;
-    if (strcasecmp(argv[0], "AF_UNIX") == 0)
-        domain = AF_UNIX;
-    else if (strcasecmp(argv[0], "AF_INET") == 0)
-        domain = AF_INET;
-    else if (strcasecmp(argv[0], "AF_INET6") == 0)
-        domain = AF_INET6;
-    else {
+    if (LOOKUP(socket_domain, argv[0], &domain) == -1) {
         warnx("create_socket: Unknown argv[1]");
         return (EX_USAGE);
     }
 
     int type;
-    if (strcasecmp(argv[1], "SOCK_STREAM") == 0)
-        type = SOCK_STREAM;
-    else if (strcasecmp(argv[1], "SOCK_DGRAM") == 0)
-        type = SOCK_DGRAM;
-    else if (strcasecmp(argv[1], "SOCK_SEQPACKET") == 0)
-        type = SOCK_SEQPACKET;
-    else {
+    if (LOOKUP(socket_type, argv[1], &type) == -1) {
         warnx("create_socket: Unknown argv[2]");
         return (EX_USAGE);
     }
@@ -1738,6 +2630,8 @@ int os_basic_builtin(WORD_LIST *_)
         { .word = (char*) info.dli_fname, .flags = 0 },
 
         { .word = "create_memfd", .flags = 0 },
+        { .word = "memfd_from", .flags = 0 },
+        { .word = "capture", .flags = 0 },
         { .word = "create_tmpfile", .flags = 0 },
 
         { .word = "lseek", .flags = 0 },
@@ -1746,18 +2640,22 @@ int os_basic_builtin(WORD_LIST *_)
         { .word = "flink", .flags = 0 },
         { .word = "fchmod", .flags = 0 },
         { .word = "fchown", .flags = 0 },
+        { .word = "fstat_many", .flags = 0 },
 
         { .word = "getresuid", .flags = 0 },
         { .word = "getresgid", .flags = 0 },
         { .word = "setresuid", .flags = 0 },
         { .word = "setresgid", .flags = 0 },
         { .word = "has_supplementary_group_member", .flags = 0 },
+        { .word = "idcache_flush", .flags = 0 },
+        { .word = "resolve_ids", .flags = 0 },
         { .word = "get_supplementary_groups", .flags = 0 },
         { .word = "set_supplementary_groups", .flags = 0 },
 
         { .word = "create_unixsocketpair", .flags = 0 },
         { .word = "fdputs", .flags = 0 },
         { .word = "fdecho", .flags = 0 },
+        { .word = "fdscan", .flags = 0 },
         { .word = "sendfds", .flags = 0 },
         { .word = "recvfds", .flags = 0 },
 
@@ -25,10 +25,20 @@
 #include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/mount.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
 
 #include <linux/securebits.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 
 #include <sched.h>
+#include <signal.h>
+#include <dirent.h>
+#include <time.h>
+#include <poll.h>
+#include <limits.h>
 
 #include <errno.h>
 
@@ -37,6 +47,9 @@
 #include <cap-ng.h>
 #include <seccomp.h>
 
+#define LOOKUP_TABLES_SANDBOXING
+#include "lookup_tables.h"
+
 #if defined(__hppa__) || defined(__ia64__)
 # define STACK_GROWS_DOWN 0
 #else
@@ -45,42 +58,155 @@
 
 #define STACK(addr, len) ((addr) + (len) * STACK_GROWS_DOWN)
 
-static void *libcapng_handle;
-static void *libseccomp_handle;
+/**
+ * Symbols used from libcap-ng.so and libseccomp.so.
+ *
+ * Every symbol of a library is resolved at once the first time any of them is needed
+ * (or by sandboxing_preload), and the resulting table is shared by all builtins, so that
+ * scripts adding hundreds of rules only pay for dlopen/dlsym once.
+ *
+ * If SANDBOXING_DIRECT_LINK is defined, both libraries are linked into sandboxing instead
+ * (check SANDBOXING_LINK in Makefile), the table is initialized statically and
+ * load_lib*_sym are direct references to the symbols.
+ */
+#define LIBCAPNG_SYMS(X)              \
+    X(capng_clear)                    \
+    X(capng_fill)                     \
+    X(capng_apply)                    \
+    X(capng_update)                   \
+    X(capng_have_capability)          \
+    X(capng_have_capabilities)        \
+    X(capng_name_to_capability)
+
+#define LIBSECCOMP_SYMS(X)            \
+    X(seccomp_init)                   \
+    X(seccomp_reset)                  \
+    X(seccomp_release)                \
+    X(seccomp_arch_resolve_name)      \
+    X(seccomp_arch_native)            \
+    X(seccomp_arch_add)               \
+    X(seccomp_arch_remove)            \
+    X(seccomp_arch_exist)             \
+    X(seccomp_syscall_resolve_name_arch) \
+    X(seccomp_rule_add_array)         \
+    X(seccomp_attr_set)               \
+    X(seccomp_syscall_priority)       \
+    X(seccomp_load)                   \
+    X(seccomp_export_bpf)             \
+    X(seccomp_export_pfc)             \
+    X(seccomp_api_get)                \
+    X(seccomp_version)                \
+    X(seccomp_notify_fd)              \
+    X(seccomp_syscall_resolve_num_arch)
+
+#define SYM_INDEX(sym) sym ## _index,
+#define SYM_NAME(sym) # sym,
+#define SYM_ADDR(sym) (void*) &sym,
+
+enum {
+    LIBCAPNG_SYMS(SYM_INDEX)
+    libcapng_nsyms
+};
+enum {
+    LIBSECCOMP_SYMS(SYM_INDEX)
+    libseccomp_nsyms
+};
+
+struct dynlib {
+    const char *name;
+    /**
+     * Tried before name, since some distributions only ship the versioned library
+     * without the development package.
+     */
+    const char *versioned_name;
+    void *handle;
+
+    size_t nsyms;
+    const char * const *sym_names;
+    /**
+     * syms[i] == NULL if sym_names[i] is missing in the installed version of the library.
+     */
+    void **syms;
+};
+
+#ifdef SANDBOXING_DIRECT_LINK
+# define SYMS_INIT(syms) = { syms(SYM_ADDR) }
+#else
+# define SYMS_INIT(syms)
+#endif
+
+static const char * const libcapng_sym_names[] = { LIBCAPNG_SYMS(SYM_NAME) };
+static void *libcapng_syms[libcapng_nsyms] SYMS_INIT(LIBCAPNG_SYMS);
+static struct dynlib libcapng = {
+    "libcap-ng.so", "libcap-ng.so.0", NULL, libcapng_nsyms, libcapng_sym_names, libcapng_syms
+};
+
+static const char * const libseccomp_sym_names[] = { LIBSECCOMP_SYMS(SYM_NAME) };
+static void *libseccomp_syms[libseccomp_nsyms] SYMS_INIT(LIBSECCOMP_SYMS);
+static struct dynlib libseccomp = {
+    "libseccomp.so", "libseccomp.so.2", NULL, libseccomp_nsyms, libseccomp_sym_names, libseccomp_syms
+};
+
+#ifdef SANDBOXING_DIRECT_LINK
+# define is_dynlib_loaded(lib) 1
+#else
+# define is_dynlib_loaded(lib) ((lib)->handle != NULL)
+#endif
 
 static scmp_filter_ctx seccomp_ctx;
 
-void unload_dynlib_impl(void *handle, const char *handle_name)
+void unload_dynlib(struct dynlib *lib)
 {
-    if (handle != NULL) {
-        if (dlclose(handle) != 0)
-            warnx("dlclose %s failed: %s", handle_name, dlerror());
+#ifdef SANDBOXING_DIRECT_LINK
+    (void) lib;
+#else
+    if (lib->handle != NULL) {
+        if (dlclose(lib->handle) != 0)
+            warnx("dlclose %s failed: %s", lib->name, dlerror());
+        lib->handle = NULL;
     }
+    memset(lib->syms, 0, lib->nsyms * sizeof(void*));
+#endif
 }
-#define unload_dynlib(handle) unload_dynlib_impl((handle), # handle)
 
-void* load_dynlib(const char *filename)
+/**
+ * @return 0 on success, -1 if failed to load the library.
+ *
+ * Resolves all symbols in lib if lib isn't loaded yet.
+ */
+int load_dynlib(struct dynlib *lib)
 {
-    void *handle = dlopen(filename, RTLD_LAZY | RTLD_LOCAL);
+    if (is_dynlib_loaded(lib))
+        return 0;
+
+    void *handle = dlopen(lib->versioned_name, RTLD_NOW | RTLD_LOCAL);
     if (handle == NULL)
-        warnx("failed to load %s: %s", filename, dlerror());
-    return handle;
+        handle = dlopen(lib->name, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        warnx("failed to load %s: %s", lib->name, dlerror());
+        return -1;
+    }
+
+    for (size_t i = 0; i != lib->nsyms; ++i)
+        lib->syms[i] = dlsym(handle, lib->sym_names[i]);
+
+    lib->handle = handle;
+
+    return 0;
 }
-void* load_sym_impl(void *handle, const char *symbol, const char *dyn_name)
+/**
+ * @return NULL if failed to load lib or the symbol is missing.
+ */
+void* load_sym(struct dynlib *lib, size_t i)
 {
-    void *sym_addr = dlsym(handle, symbol);
+    if (load_dynlib(lib) == -1)
+        return NULL;
+
+    void *sym_addr = lib->syms[i];
     if (sym_addr == NULL)
-        warnx("failed to load %s from %s: %s", symbol, dyn_name, dlerror());
+        warnx("%s is missing from the installed %s", lib->sym_names[i], lib->name);
     return sym_addr;
 }
-void* load_sym(void **handle, const char *dyn_name, const char *symbol)
-{
-    if (*handle == NULL) {
-        if ((*handle = load_dynlib(dyn_name)) == NULL)
-            return NULL;
-    }
-    return load_sym_impl(*handle, symbol, dyn_name);
-}
 
 /**
  * Called when `sandboxing' is enabled and loaded from the shared object.
@@ -89,27 +215,92 @@ void* load_sym(void **handle, const char *dyn_name, const char *symbol)
  */
 PUBLIC int sandboxing_builtin_load(char *name)
 {
-    libcapng_handle = NULL;
-    libseccomp_handle = NULL;
+    libcapng.handle = NULL;
+    libseccomp.handle = NULL;
     seccomp_ctx = NULL;
     return (1);
 }
 
 int call_seccomp_release(scmp_filter_ctx ctx);
+void seccomp_profile_release(void);
 /**
  * Called when `template' is disabled.
  */
 PUBLIC void sandboxing_builtin_unload(char *name)
 {
-    unload_dynlib(libcapng_handle);
+    unload_dynlib(&libcapng);
+    seccomp_profile_release();
     if (seccomp_ctx != NULL) {
-        if (libseccomp_handle != NULL)
+        if (is_dynlib_loaded(&libseccomp))
             call_seccomp_release(seccomp_ctx);
         else
-            warnx("sandboxing_builtin_unload: seccomp_ctx != NULL but %s == NULL", "libseccomp_handle");
+            warnx("sandboxing_builtin_unload: seccomp_ctx != NULL but %s == NULL", "libseccomp.handle");
+    }
+    unload_dynlib(&libseccomp);
+    arena_free_all(&vla_arena);
+}
+
+int sandboxing_preload_builtin(WORD_LIST *list)
+{
+    if (check_no_options(&list) == -1)
+        return (EX_USAGE);
+
+    const char *varname = NULL;
+    if (to_argv_opt(list, 0, 1, &varname) == -1)
+        return (EX_USAGE);
+
+    struct dynlib *libs[] = { &libcapng, &libseccomp };
+
+    int ret = (EXECUTION_SUCCESS);
+
+    ARRAY *array = NULL;
+    if (varname != NULL)
+        array = array_cell(make_new_array_variable((char*) varname));
+
+    arrayind_t nmissing = 0;
+    for (size_t i = 0; i != sizeof(libs) / sizeof(struct dynlib*); ++i) {
+        if (load_dynlib(libs[i]) == -1) {
+            ret = (EXECUTION_FAILURE);
+            continue;
+        }
+
+        for (size_t j = 0; j != libs[i]->nsyms; ++j) {
+            if (libs[i]->syms[j] != NULL)
+                continue;
+
+            if (array != NULL)
+                array_insert(array, nmissing, (char*) libs[i]->sym_names[j]);
+            else
+                printf("%s: %s\n", libs[i]->name, libs[i]->sym_names[j]);
+            ++nmissing;
+        }
     }
-    unload_dynlib(libseccomp_handle);
+
+    if (ret == (EXECUTION_SUCCESS) && nmissing != 0)
+        ret = 3;
+
+    return ret;
 }
+PUBLIC struct builtin sandboxing_preload_struct = {
+    "sandboxing_preload",       /* builtin name */
+    sandboxing_preload_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,            /* initial flags for builtin */
+    (char*[]){
+        "sandboxing_preload loads libcap-ng.so and libseccomp.so and resolves all symbols used by",
+        "capng_* and seccomp_* at once.",
+        "",
+        "Without it, this is done lazily by the first capng_*/seccomp_* builtin invoked.",
+        "If sandboxing is built with SANDBOXING_LINK=shared or static, it has nothing to do.",
+        "",
+        "Symbols missing in the installed version of these libraries are stored in $var as array",
+        "if var is present, otherwise they are printed to stdout.",
+        "",
+        "Returns 1 if any of the libraries failed to load, 3 if any symbol is missing.",
+        (char*) NULL
+    },                          /* array of long documentation strings. */
+    "sandboxing_preload [var]",  /* usage synopsis; becomes short_doc */
+    0                           /* reserved for internal use */
+};
 
 int enable_no_new_privs_strict_builtin(WORD_LIST *list)
 {
@@ -144,18 +335,13 @@ int set_securebits_builtin(WORD_LIST *list)
 
     unsigned long flags = 0;
     for (int i = 1; list != NULL; list = list->next, ++i) {
-        if (strcasecmp(list->word->word, "KEEP_CAPS") == 0)
-            flags |= SECBIT_KEEP_CAPS | (locked & SECBIT_KEEP_CAPS_LOCKED);
-        else if (strcasecmp(list->word->word, "NO_SETUID_FIXUP") == 0)
-            flags |= SECBIT_NO_SETUID_FIXUP | (locked & SECBIT_NO_SETUID_FIXUP_LOCKED);
-        else if (strcasecmp(list->word->word, "NOROOT") == 0)
-            flags |= SECBIT_NOROOT | (locked & SECBIT_NOROOT_LOCKED);
-        else if (strcasecmp(list->word->word, "NO_CAP_AMBIENT_RAISE") == 0)
-            flags |= SECBIT_NO_CAP_AMBIENT_RAISE | (locked & SECBIT_NO_CAP_AMBIENT_RAISE_LOCKED);
-        else {
+        unsigned long bit;
+        if (LOOKUP(securebit, list->word->word, &bit) == -1) {
             warnx("Invalid argv[%d]", i);
             return (EX_USAGE);
         }
+        // SECBIT_*_LOCKED is always the next bit of SECBIT_*
+        flags |= bit | (locked & (bit << 1));
     }
 
     if (prctl(PR_SET_SECUREBITS, flags, 0, 0, 0) == -1) {
@@ -410,19 +596,12 @@ int parse_mount_options(const char *options, unsigned long *flags, const char *f
     for (size_t i = 0; options[0] != '\0'; ++i) {
         const char *opt_end = strchrnul(options, ',');
 
-        size_t opt_len = opt_end - options;
-        if (strncasecmp(options, "RDONLY", opt_len) == 0)
-            *flags |= MS_RDONLY;
-        else if (strncasecmp(options, "NOEXEC", opt_len) == 0)
-            *flags |= MS_NOEXEC;
-        else if (strncasecmp(options, "NOSUID", opt_len) == 0)
-            *flags |= MS_NOSUID;
-        else if (strncasecmp(options, "NODEV", opt_len) == 0)
-            *flags |= MS_NODEV;
-        else {
+        unsigned long flag;
+        if (LOOKUP_N(mount_option, options, opt_end - options, &flag) == -1) {
             warnx("%s: Invalid option[%zu] provided", fname, i);
             return -1;
         }
+        *flags |= flag;
 
         if (opt_end[0] == '\0')
             break;
@@ -847,24 +1026,21 @@ PUBLIC struct builtin mount_pseudo_struct = {
     0                             /* reserved for internal use */
 };
 
-static const char *libcapng_lib_name = "libcap-ng.so";
-#define load_libcapng_sym(sym)                     \
+#ifdef SANDBOXING_DIRECT_LINK
+# define load_libcapng_sym(sym) ((void*) &sym)
+#else
+# define load_libcapng_sym(sym)                    \
     ({                                              \
-        void *ret = load_sym(&libcapng_handle, libcapng_lib_name, (sym)); \
+        void *ret = load_sym(&libcapng, sym ## _index); \
         if (ret == NULL)                            \
             return (EXECUTION_FAILURE);             \
         ret;                                        \
      })
+#endif
 
 int parse_capng_select(const char *arg, size_t i, capng_select_t *set, const char *fname)
 {
-    if (strcasecmp(arg, "BOUNDS") == 0)
-        *set = CAPNG_SELECT_BOUNDS;
-    else if (strcasecmp(arg, "CAPS") == 0)
-        *set = CAPNG_SELECT_CAPS;
-    else if (strcasecmp(arg, "BOTH") == 0)
-        *set = CAPNG_SELECT_BOTH;
-    else {
+    if (LOOKUP(capng_select, arg, set) == -1) {
         warnx("%s: argv[%zu] is invalid", fname, i + 1);
         return -1;
     }
@@ -900,7 +1076,7 @@ int capng_clear_builtin(WORD_LIST *list)
     capng_select_t set = readin_capng_select_only(list);
 
     typedef void (*capng_clear_t)(capng_select_t);
-    capng_clear_t capng_clear_p = load_libcapng_sym(self_name);
+    capng_clear_t capng_clear_p = load_libcapng_sym(capng_clear);
     capng_clear_p(set);
 
     return (EXECUTION_SUCCESS);
@@ -928,7 +1104,7 @@ int capng_fill_builtin(WORD_LIST *list)
     capng_select_t set = readin_capng_select_only(list);
 
     typedef void (*capng_fill_t)(capng_select_t);
-    capng_fill_t capng_fill_p = load_libcapng_sym(self_name);
+    capng_fill_t capng_fill_p = load_libcapng_sym(capng_fill);
     capng_fill_p(set);
 
     return (EXECUTION_SUCCESS);
@@ -956,7 +1132,7 @@ int capng_apply_builtin(WORD_LIST *list)
     capng_select_t set = readin_capng_select_only(list);
 
     typedef int (*capng_apply_t)(capng_select_t);
-    capng_apply_t capng_apply_p = load_libcapng_sym(self_name);
+    capng_apply_t capng_apply_p = load_libcapng_sym(capng_apply);
     if (capng_apply_p(set) == -1) {
         warnx("%s failed", self_name);
         return (EXECUTION_FAILURE);
@@ -997,16 +1173,12 @@ int capng_update_builtin(WORD_LIST *list)
         return (EX_USAGE);
 
     capng_act_t action;
-    if (strcasecmp(argv[0], "ADD") == 0)
-        action = CAPNG_ADD;
-    else if (strcasecmp(argv[0], "DROP") == 0)
-        action = CAPNG_DROP;
-    else {
+    if (LOOKUP(capng_act, argv[0], &action) == -1) {
         warnx("%s: Invalid first non-option arg", self_name);
         return (EX_USAGE);
     }
 
-    capng_name_to_cap_t capng_name_to_cap_p = load_libcapng_sym("capng_name_to_capability");
+    capng_name_to_cap_t capng_name_to_cap_p = load_libcapng_sym(capng_name_to_capability);
 
     const int cap = capng_name_to_cap_p(argv[1]);
     if (cap < 0) {
@@ -1014,7 +1186,7 @@ int capng_update_builtin(WORD_LIST *list)
         return (EX_USAGE);
     }
 
-    capng_update_t capng_update_p = load_libcapng_sym(self_name);
+    capng_update_t capng_update_p = load_libcapng_sym(capng_update);
 
     if (capng_update_p(action, type, cap) == -1) {
         warnx("%s failed", self_name);
@@ -1058,21 +1230,12 @@ int capng_have_capability_builtin(WORD_LIST *list)
         return (EX_USAGE);
 
     capng_type_t type;
-
-    if (strcasecmp(argv[0], "EFFECTIVE") == 0)
-        type = CAPNG_EFFECTIVE;
-    else if (strcasecmp(argv[0], "PERMITTED") == 0)
-        type = CAPNG_PERMITTED;
-    else if (strcasecmp(argv[0], "INHERITABLE") == 0)
-        type = CAPNG_INHERITABLE;
-    else if (strcasecmp(argv[0], "BOUNDING_SET") == 0)
-        type = CAPNG_BOUNDING_SET;
-    else {
+    if (LOOKUP(capng_type, argv[0], &type) == -1) {
         warnx("%s: Unknown argv[1]", self_name);
         return (EX_USAGE);
     }
 
-    capng_name_to_cap_t capng_name_to_cap_p = load_libcapng_sym("capng_name_to_capability");
+    capng_name_to_cap_t capng_name_to_cap_p = load_libcapng_sym(capng_name_to_capability);
 
     const int cap = capng_name_to_cap_p(argv[1]);
     if (cap < 0) {
@@ -1080,7 +1243,7 @@ int capng_have_capability_builtin(WORD_LIST *list)
         return (EX_USAGE);
     }
 
-    capng_have_cap_t capng_have_cap_p = load_libcapng_sym(self_name);
+    capng_have_cap_t capng_have_cap_p = load_libcapng_sym(capng_have_capability);
 
     return !capng_have_cap_p(type, cap);
 }
@@ -1105,7 +1268,7 @@ int capng_have_capabilities_builtin(WORD_LIST *list)
 
     capng_select_t set = readin_capng_select_only(list);
 
-    capng_have_caps_t capng_have_caps_p = load_libcapng_sym(self_name);
+    capng_have_caps_t capng_have_caps_p = load_libcapng_sym(capng_have_capabilities);
 
     switch (capng_have_caps_p(set)) {
         case CAPNG_FAIL:
@@ -1122,7 +1285,7 @@ int capng_have_capabilities_builtin(WORD_LIST *list)
             return 0;
 
         default:
-            warnx("%s: %s from %s %s", self_name, self_name, libcapng_lib_name, "returns unknown return value");
+            warnx("%s: %s from %s %s", self_name, self_name, libcapng.name, "returns unknown return value");
             return (EXECUTION_FAILURE);
     }
 }
@@ -1148,50 +1311,53 @@ PUBLIC struct builtin capng_have_capabilities_struct = {
     0                             /* reserved for internal use */
 };
 
-static const char *libseccomp_lib_name = "libseccomp.so";
-#define load_libseccomp_sym(sym)                    \
+#ifdef SANDBOXING_DIRECT_LINK
+# define load_libseccomp_sym(sym) ((void*) &sym)
+#else
+# define load_libseccomp_sym(sym)                  \
     ({                                              \
-        void *ret = load_sym(&libseccomp_handle, libseccomp_lib_name, (sym)); \
+        void *ret = load_sym(&libseccomp, sym ## _index); \
         if (ret == NULL)                            \
             return (EXECUTION_FAILURE);             \
         ret;                                        \
      })
+#endif
 
 int call_seccomp_release(scmp_filter_ctx ctx)
 {
     typedef void (*seccoomp_rel_t)(scmp_filter_ctx);
-    seccoomp_rel_t seccoomp_rel_p = load_libseccomp_sym("seccomp_release");
+    seccoomp_rel_t seccoomp_rel_p = load_libseccomp_sym(seccomp_release);
     seccoomp_rel_p(ctx);
     return (EXECUTION_SUCCESS);
 }
 
 #define CHECK_SECCOMP_CTX_NOT_NULL() \
     if (seccomp_ctx == NULL) {       \
-        warnx("%s isn't initialized yet!\nCall %s to initialize it.", libseccomp_lib_name, "seccomp_init"); \
+        warnx("%s isn't initialized yet!\nCall %s to initialize it.", libseccomp.name, "seccomp_init"); \
         return (EXECUTION_FAILURE);  \
     }
 
-int parse_action(const char *arg, uint32_t *action, const char *fname, size_t i)
+/**
+ * @return 0 on success, -1 on failure and print err msg to stderr.
+ *
+ * NOTE that this function does not call builtin_usage on error.
+ */
+int parse_action_impl(const char *arg, uint32_t *action, const char *fname, size_t i)
 {
-    if (strcasecmp(arg, "KILL") == 0)
-        *action = SCMP_ACT_KILL;
-    else if (strcasecmp(arg, "KILL_PROCESS") == 0)
-        *action = SCMP_ACT_KILL_PROCESS;
-    else if (strcasecmp(arg, "TRAP") == 0)
-        *action = SCMP_ACT_TRAP;
-    else if (strncasecmp(arg, "ERRNO:", 6) == 0) {
+    if (strncasecmp(arg, "ERRNO:", 6) == 0) {
         int errno_v = parse_errno(arg + 6, i + 1, fname);
-        if (errno_v == -1) {
-            builtin_usage();
+        if (errno_v == -1)
             return -1;
-        }
         *action = SCMP_ACT_ERRNO(errno_v);
-    } else if (strcasecmp(arg, "LOG") == 0)
-        *action = SCMP_ACT_LOG;
-    else if (strcasecmp(arg, "ALLOW") == 0)
-        *action = SCMP_ACT_ALLOW;
-    else {
+    } else if (LOOKUP(seccomp_action, arg, action) == -1) {
         warnx("%s: parse_action: Invalid %zu arg", fname, i + 1);
+        return -1;
+    }
+    return 0;
+}
+int parse_action(const char *arg, uint32_t *action, const char *fname, size_t i)
+{
+    if (parse_action_impl(arg, action, fname, i) == -1) {
         builtin_usage();
         return -1;
     }
@@ -1218,13 +1384,13 @@ int seccomp_init_builtin(WORD_LIST *list)
     int ret = (EXECUTION_SUCCESS);
 
     if (seccomp_ctx) {
-        seccomp_reset_t seccomp_reset_p = load_libseccomp_sym("seccomp_reset");
+        seccomp_reset_t seccomp_reset_p = load_libseccomp_sym(seccomp_reset);
         if (seccomp_reset_p(seccomp_ctx, def_actions) != 0) {
             warnx("%s: %s failed", self_name, "seccomp_reset");
             ret = (EXECUTION_FAILURE);
         }
     } else {
-        seccomp_init_t seccomp_init_p = load_libseccomp_sym("seccomp_init");
+        seccomp_init_t seccomp_init_p = load_libseccomp_sym(seccomp_init);
         seccomp_ctx = seccomp_init_p(def_actions);
         if (seccomp_ctx == NULL) {
             warnx("%s: %s failed", self_name, "seccomp_init");
@@ -1296,8 +1462,7 @@ int resolve_arch(const char *arg, uint32_t *arch, const char *fname)
     typedef uint32_t (*seccomp_arch_native_t)();
 
     if (strcasecmp(arg, "native") != 0) {
-        const char *sym = "seccomp_arch_resolve_name";
-        seccomp_arch_resolve_name_t seccomp_arch_resolve_name_p = load_libseccomp_sym(sym);
+        seccomp_arch_resolve_name_t seccomp_arch_resolve_name_p = load_libseccomp_sym(seccomp_arch_resolve_name);
 
         *arch = seccomp_arch_resolve_name_p(arg);
         if (*arch == 0) {
@@ -1305,21 +1470,25 @@ int resolve_arch(const char *arg, uint32_t *arch, const char *fname)
             return (EX_USAGE);
         }
     } else {
-        seccomp_arch_native_t seccomp_arch_native_p = load_libseccomp_sym("seccomp_arch_native");
+        seccomp_arch_native_t seccomp_arch_native_p = load_libseccomp_sym(seccomp_arch_native);
         *arch = seccomp_arch_native_p();
     }
 
     return (EXECUTION_SUCCESS);
 }
-int get_arch(WORD_LIST **list, uint32_t *arch, const char *fname)
+/**
+ * @param file if not NULL, then '-f file' is also accepted and *file is set to file,
+ *             or NULL if '-f' isn't passed.
+ */
+int get_arch_and_file(WORD_LIST **list, uint32_t *arch, const char **file, const char *fname)
 {
-    typedef uint32_t (*seccomp_arch_native_t)();
-    typedef uint32_t (*seccomp_arch_resolve_name_t)(const char*);
-
     int has_set_arch = 0;
 
+    if (file != NULL)
+        *file = NULL;
+
     reset_internal_getopt();
-    for (int opt; (opt = internal_getopt(*list, "a:")) != -1; ) {
+    for (int opt; (opt = internal_getopt(*list, file != NULL ? "a:f:" : "a:")) != -1; ) {
         switch (opt) {
             case 'a':
             if (!has_set_arch) {
@@ -1334,6 +1503,15 @@ int get_arch(WORD_LIST **list, uint32_t *arch, const char *fname)
             }
             break;
 
+            case 'f':
+            if (*file == NULL)
+                *file = list_optarg;
+            else {
+                warnx("%s: Switch -f is specified twice", fname);
+                return (EX_USAGE);
+            }
+            break;
+
             CASE_HELPOPT;
 
             default:
@@ -1351,32 +1529,267 @@ int get_arch(WORD_LIST **list, uint32_t *arch, const char *fname)
 
     return ret;
 }
+int get_arch(WORD_LIST **list, uint32_t *arch, const char *fname)
+{
+    return get_arch_and_file(list, arch, NULL, fname);
+}
 int seccomp_resolve_syscall(uint32_t arch, const char *arg, int *syscall_num, size_t i, const char *fname)
 {
     typedef int (*resolver_t)(uint32_t, const char*);
-    resolver_t seccomp_syscall_resolver_p = load_libseccomp_sym("seccomp_syscall_resolve_name_arch");
+    resolver_t seccomp_syscall_resolver_p = load_libseccomp_sym(seccomp_syscall_resolve_name_arch);
 
     *syscall_num = seccomp_syscall_resolver_p(arch, arg);
     if (*syscall_num == __NR_SCMP_ERROR) {
-        warnx("%s: Invalid syscall in %zu arg", fname, i + 1);
+        warnx("%s: Invalid syscall %s in %zu arg", fname, arg, i + 1);
+        return (EX_USAGE);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+/**
+ * @param arg in the format of "A{arg}_{bits} op val" or "A{arg}_{bits} & bitmask == val".
+ * @param i index of arg, used in err msg.
+ * @return EXECUTION_SUCCESS, EX_USAGE or EXECUTION_FAILURE.
+ */
+int parse_arg_cmp(const char *arg, struct scmp_arg_cmp *arg_cmp, const char *fname, size_t i)
+{
+    uint64_t narg;
+    uint64_t bit;
+
+    char op[3];
+    uint64_t arg1;
+    uint64_t arg2;
+
+    int n;
+    int result = sscanf(arg, "A%" PRIu64 "_%" PRIu64 " %2s %" PRIu64 " %n", &narg, &bit, op, &arg1, &n);
+
+    if (result == EOF) {
+        warn("%s: sscanf on %zu arg failed", fname, i + 1);
+        return (EXECUTION_FAILURE);
+    } else if (result != 4 || narg > 5 || (bit != 32 && bit != 64)) {
+        // narg and bit are only set if result is 4
+        const char *err_msg;
+        if (result != 4)
+            err_msg = "Invalid format";
+        else if (narg > 5)
+            err_msg = "narg too large";
+        else
+            err_msg = "bit is neither 32 nor 64";
+        warnx("%s: Invalid %zu arg: %s", fname, i + 1, err_msg);
         return (EX_USAGE);
     }
 
+    enum scmp_compare op_enum;
+    switch (((int) op[0] << 8) | (int) op[1]) {
+        default:
+            warnx("%s: Invalid %zu arg: %s", fname, i + 1, "Invalid operator");
+            return (EX_USAGE);
+
+        case ((int) '<' << 8) | (int) '\0':
+            op_enum = SCMP_CMP_LT;
+            break;
+
+        case ((int) '<' << 8) | (int) '=':
+            op_enum = SCMP_CMP_LE;
+            break;
+
+        case ((int) '>' << 8) | (int) '\0':
+            op_enum = SCMP_CMP_GT;
+            break;
+
+        case ((int) '>' << 8) | (int) '=':
+            op_enum = SCMP_CMP_GE;
+            break;
+
+        case ((int) '=' << 8) | (int) '=':
+            op_enum = SCMP_CMP_EQ;
+            break;
+
+        case ((int) '!' << 8) | (int) '=':
+            op_enum = SCMP_CMP_NE;
+            break;
+
+        case ((int) '&' << 8) | (int) '\0':
+            op_enum = SCMP_CMP_MASKED_EQ;
+            arg += n;
+            result = sscanf(arg, "== %" PRIu64 " %n", &arg2, &n);
+            if (result == EOF) {
+                warn("%s: sscanf on %zu arg failed", fname, i + 1);
+                return (EXECUTION_FAILURE);
+            } else if (result != 1) {
+                warnx("%s: Invalid %zu arg: %s", fname, i + 1, "Invalid format");
+                return (EX_USAGE);
+            }
+            break;
+    }
+
+    if (arg[n] != '\0') {
+         warnx("%s: Invalid %zu arg: %s", fname, i + 1, "Too many parameters");
+         return (EX_USAGE);
+    }
+
+    if (bit == 32) {
+        if (op_enum != SCMP_CMP_MASKED_EQ)
+            *arg_cmp = SCMP_CMP32(narg, op_enum, arg1);
+        else
+            *arg_cmp = SCMP_CMP32(narg, op_enum, arg1, arg2);
+    } else {
+        if (op_enum != SCMP_CMP_MASKED_EQ)
+            *arg_cmp = SCMP_CMP64(narg, op_enum, arg1);
+        else
+            *arg_cmp = SCMP_CMP64(narg, op_enum, arg1, arg2);
+    }
+
     return (EXECUTION_SUCCESS);
 }
+typedef int (*seccomp_rule_addv_t)(scmp_filter_ctx, uint32_t, int, unsigned, const struct scmp_arg_cmp*);
+/**
+ * Adds a rule for each syscall in names, which are separated by whitespaces or ','.
+ * If allow_comments, then '#' starts a comment that ends at the end of the line.
+ *
+ * Failure is reported per syscall and does not stop the rest of syscalls from being added.
+ *
+ * @param names would be modified.
+ * @param i index of names in args, used in err msg.
+ * @return EXECUTION_SUCCESS, or the status of the first failure.
+ */
+int seccomp_rule_add_syscalls(seccomp_rule_addv_t seccomp_rule_addv_p, char *names, int allow_comments,
+                              uint32_t arch, uint32_t action, unsigned arg_cnt,
+                              const struct scmp_arg_cmp *arg_cmp, size_t i, const char *fname)
+{
+    const char *seps = allow_comments ? " \t\r\n,#" : " \t\r\n,";
+
+    int ret = (EXECUTION_SUCCESS);
+    size_t nsyscalls = 0;
+
+    for (char *name = names; ; ) {
+        name += strspn(name, " \t\r\n,");
+        if (allow_comments && *name == '#') {
+            name += strcspn(name, "\n");
+            continue;
+        } else if (*name == '\0')
+            break;
+
+        char *end = name + strcspn(name, seps);
+        char sep = *end;
+        *end = '\0';
+
+        int syscall_num;
+        int result = seccomp_resolve_syscall(arch, name, &syscall_num, i, fname);
+        if (result == (EXECUTION_SUCCESS)) {
+            result = seccomp_rule_addv_p(seccomp_ctx, action, syscall_num, arg_cnt, arg_cmp);
+            if (result != 0) {
+                errno = -result;
+                warn("%s: %s from %s failed on syscall %s", fname, "seccomp_rule_add_array", 
+                     libseccomp.name, name);
+                result = (EXECUTION_FAILURE);
+            }
+        }
+
+        if (ret == (EXECUTION_SUCCESS))
+            ret = result;
+
+        ++nsyscalls;
+
+        *end = sep;
+        name = end;
+    }
+
+    if (nsyscalls == 0) {
+        warnx("%s: No syscall_name is specified", fname);
+        return (EX_USAGE);
+    }
+
+    return ret;
+}
+/**
+ * @param len set to length of the content on success.
+ * @return content of fd terminated by '\0' on success, NULL on failure.
+ *         The returned buffer should be freed by the caller.
+ */
+char* read_whole_file(int fd, size_t *len, const char *fname)
+{
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1) {
+        warn("%s: fstat failed", fname);
+        return NULL;
+    }
+
+    // +1 for the trailing '\0' and +1 so that EOF of a regular file can be read without realloc.
+    size_t cap = S_ISREG(statbuf.st_mode) ? statbuf.st_size + 2 : 4096;
+    *len = 0;
+
+    char *buffer = malloc(cap);
+    if (buffer == NULL) {
+        warn("%s: malloc failed", fname);
+        return NULL;
+    }
+
+    for (; ;) {
+        if (*len + 1 == cap) {
+            void *p = realloc(buffer, cap * 2);
+            if (p == NULL) {
+                warn("%s: realloc failed", fname);
+                (free)(buffer);
+                return NULL;
+            }
+            buffer = p;
+            cap *= 2;
+        }
+
+        ssize_t result = read(fd, buffer + *len, cap - 1 - *len);
+        if (result == -1) {
+            if (errno == EINTR)
+                continue;
+            warn("%s: read failed", fname);
+            (free)(buffer);
+            return NULL;
+        } else if (result == 0)
+            break;
+
+        *len += result;
+    }
+    buffer[*len] = '\0';
+
+    return buffer;
+}
+
+/**
+ * @return NULL on failure.
+ */
+char* read_whole_file_at(const char *path, size_t *len, const char *fname)
+{
+    int fd;
+    do {
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+    } while (fd == -1 && errno == EINTR);
+    if (fd == -1) {
+        warn("%s: open %s failed", fname, path);
+        return NULL;
+    }
+
+    char *content = read_whole_file(fd, len, fname);
+    close(fd);
+
+    return content;
+}
 int seccomp_rule_add_builtin(WORD_LIST *list)
 {
     const char *self_name = "seccomp_rule_add";
 
     uint32_t arch;
+    const char *file;
     {
-        int result = get_arch(&list, &arch, self_name);
+        int result = get_arch_and_file(&list, &arch, &file, self_name);
         if (result != (EXECUTION_SUCCESS))
             return result;
     }
 
+    // If '-f' is passed, syscall_names are read from file instead.
+    const int nargs = file == NULL ? 2 : 1;
+
     const char* argv[2];
-    if (readin_args(&list, 2, argv) != 2) {
+    if (readin_args(&list, nargs, argv) != nargs) {
         builtin_usage();
         return (EX_USAGE);
     }
@@ -1385,18 +1798,9 @@ int seccomp_rule_add_builtin(WORD_LIST *list)
     if (parse_action(argv[0], &action, self_name, 0) == -1)
         return (EX_USAGE);
 
-    int syscall_num;
-    {
-        int result = seccomp_resolve_syscall(arch, argv[1], &syscall_num, 1, self_name);
-        if (result != (EXECUTION_SUCCESS))
-            return result;
-    }
-
     CHECK_SECCOMP_CTX_NOT_NULL();
 
-    typedef int (*seccomp_rule_addv_t)(scmp_filter_ctx, uint32_t, int, unsigned, const struct scmp_arg_cmp*);
-    const char *loaded_fname = "seccomp_rule_add_array";
-    seccomp_rule_addv_t seccomp_rule_addv_p = load_libseccomp_sym(loaded_fname);
+    seccomp_rule_addv_t seccomp_rule_addv_p = load_libseccomp_sym(seccomp_rule_add_array);
 
     int argc = list_length(list);
 
@@ -1406,104 +1810,30 @@ int seccomp_rule_add_builtin(WORD_LIST *list)
     int ret = (EXECUTION_SUCCESS);
 
     for (int i = 0; i != argc; ++i, list = list->next) {
-        const char *arg = list->word->word;
-
-        uint64_t narg;
-        uint64_t bit;
-
-        char op[3];
-        uint64_t arg1;
-        uint64_t arg2;
-
-        int n;
-        int result = sscanf(arg, "A%" PRIu64 "_%" PRIu64 " %2s %" PRIu64 " %n", &narg, &bit, op, &arg1, &n);
-
-        if (result == EOF) {
-            warn("%s: sscanf on %d arg failed", self_name, i + 3);
-            ret = (EXECUTION_FAILURE);
+        ret = parse_arg_cmp(list->word->word, arg_cmp + i, self_name, i + nargs);
+        if (ret != (EXECUTION_SUCCESS))
             goto cleanup;
-        } else if (result != 4 || narg > 5 || (bit != 32 && bit != 64)) {
-            const char *err_msg = "Invalid format";
-            if (narg > 5)
-                err_msg = "narg too large";
-            else if (bit != 32 && bit != 64)
-                err_msg = "bit is neither 32 nor 64";
-            warnx("%s: Invalid %d arg: %s", self_name, i + 3, err_msg);
-            ret = (EX_USAGE);
-            goto cleanup;
-        }
-
-        enum scmp_compare op_enum;
-        switch (((int) op[0] << 8) | (int) op[1]) {
-            default:
-                warnx("%s: Invalid %d arg: %s", self_name, i + 3, "Invalid operator");
-                ret = (EX_USAGE);
-                goto cleanup;
-
-            case ((int) '<' << 8) | (int) '\0':
-                op_enum = SCMP_CMP_LT;
-                break;
-
-            case ((int) '<' << 8) | (int) '=':
-                op_enum = SCMP_CMP_LE;
-                break;
-
-            case ((int) '>' << 8) | (int) '\0':
-                op_enum = SCMP_CMP_GT;
-                break;
-
-            case ((int) '>' << 8) | (int) '=':
-                op_enum = SCMP_CMP_GE;
-                break;
-
-            case ((int) '=' << 8) | (int) '=':
-                op_enum = SCMP_CMP_EQ;
-                break;
-
-            case ((int) '!' << 8) | (int) '=':
-                op_enum = SCMP_CMP_NE;
-                break;
-
-            case ((int) '&' << 8) | (int) '\0':
-                op_enum = SCMP_CMP_MASKED_EQ;
-                arg += n;
-                result = sscanf(arg, "== %" PRIu64 " %n", &arg2, &n);
-                if (result == EOF) {
-                    warn("%s: sscanf on %d arg failed", self_name, i + 3);
-                    ret = (EXECUTION_FAILURE);
-                    goto cleanup;
-                } else if (result != 1) {
-                    warnx("%s: Invalid %d arg: %s", self_name, i + 3, "Invalid format");
-                    ret = (EX_USAGE);
-                    goto cleanup;
-                }
-                break;
-        }
-
-        if (arg[n] != '\0') {
-             warnx("%s: Invalid %d arg: %s", self_name, i + 3, "Too many parameters");
-             ret = (EX_USAGE);
-             goto cleanup;
-        }
-
-        if (bit == 32) {
-            if (op_enum != SCMP_CMP_MASKED_EQ)
-                arg_cmp[i] = SCMP_CMP32(narg, op_enum, arg1);
-            else
-                arg_cmp[i] = SCMP_CMP32(narg, op_enum, arg1, arg2);
-        } else {
-            if (op_enum != SCMP_CMP_MASKED_EQ)
-                arg_cmp[i] = SCMP_CMP64(narg, op_enum, arg1);
-            else
-                arg_cmp[i] = SCMP_CMP64(narg, op_enum, arg1, arg2);
-        }
     }
 
-    if (seccomp_rule_addv_p(seccomp_ctx, action, syscall_num, argc, arg_cmp) != 0) {
-        warnx("%s: %s from %s %s", self_name, loaded_fname, libseccomp_lib_name, "failed");
+    char *names;
+    size_t len;
+    if (file == NULL)
+        names = (strdup)(argv[1]);
+    else
+        names = read_whole_file_at(file, &len, self_name);
+
+    if (names == NULL) {
+        if (file == NULL)
+            warn("%s: strdup failed", self_name);
         ret = (EXECUTION_FAILURE);
+        goto cleanup;
     }
 
+    ret = seccomp_rule_add_syscalls(seccomp_rule_addv_p, names, file != NULL, arch, action, argc, arg_cmp,
+                                    file == NULL, self_name);
+
+    (free)(names);
+
 cleanup:
     END_VLA(arg_cmp);
 
@@ -1521,6 +1851,8 @@ PUBLIC struct builtin seccomp_rule_add_struct = {
         " - \"ERRNO:errno\": The syscall will return errno.",
         " - \"LOG\": The syscall made against filter rule will be logged.",
         " - \"ALLOW\": have no effect on the thread which made a syscall against seccomp filter",
+        " - \"NOTIFY\": notify the supervisor via fd obtained by seccomp_notify_fd,",
+        "              check 'help seccomp_notify_recv' for more information.",
         "",
         "syscall_arg_requirements should be a list of arguments in the format of",
         "\"A{arg}_{bits} op val\", where op can be </<=/>/>=/==/!=/&.",
@@ -1530,16 +1862,25 @@ PUBLIC struct builtin seccomp_rule_add_struct = {
         "If you want to add a syscall for architecture other than your native arch, you can use switch -a:",
         "-a native/x86/x86-64/...",
         "",
+        "syscall_names can be a list separated by ',', and the same action and syscall_arg_requirements",
+        "are applied to every syscall in it.",
+        "If '-f file' is passed, syscall_names are read from file instead, which can be separated by",
+        "whitespaces, newlines or ',', and '#' starts a comment.",
+        "",
+        "Failure on one syscall is reported and does not stop the rest of syscalls from being added.",
+        "",
         "Example:",
         " - seccomp_rule_add KILL read 'A0_32 == 1': If the 1st argument to read equals to 0, kill the thread",
         " - seccomp_rule_add KILL write: If the thread calls write, it is killed.",
+        " - seccomp_rule_add ALLOW read,write,close: Allow read, write and close.",
+        " - seccomp_rule_add -f allowed_syscalls ALLOW: Allow syscalls listed in file allowed_syscalls.",
         (char*) NULL
     },                            /* array of long documentation strings. */
-    "seccomp_rule_add [-a arch] action syscall_name [syscall_arg_requirements]",
+    "seccomp_rule_add [-a arch] [-f file] action syscall_names [syscall_arg_requirements]",
     0                             /* reserved for internal use */
 };
 
-int seccomp_arch_template_builtin(WORD_LIST *list, const char *fname, int is_seccomp_arch_exist)
+int seccomp_arch_template_builtin(WORD_LIST *list, const char *fname, size_t sym_index, int is_seccomp_arch_exist)
 {
     typedef int (*fp)(scmp_filter_ctx, uint32_t);
 
@@ -1559,7 +1900,9 @@ int seccomp_arch_template_builtin(WORD_LIST *list, const char *fname, int is_sec
  
     CHECK_SECCOMP_CTX_NOT_NULL();
 
-    fp f = load_libseccomp_sym(fname);
+    fp f = load_sym(&libseccomp, sym_index);
+    if (f == NULL)
+        return (EXECUTION_FAILURE);
     int result = f(seccomp_ctx, arch);
 
     if (is_seccomp_arch_exist && result == -EEXIST)
@@ -1575,7 +1918,7 @@ int seccomp_arch_template_builtin(WORD_LIST *list, const char *fname, int is_sec
 }
 int seccomp_arch_add_builtin(WORD_LIST *list)
 {
-    return seccomp_arch_template_builtin(list, "seccomp_arch_add", 0);
+    return seccomp_arch_template_builtin(list, "seccomp_arch_add", seccomp_arch_add_index, 0);
 }
 PUBLIC struct builtin seccomp_arch_add_struct = {
     "seccomp_arch_add",       /* builtin name */
@@ -1593,7 +1936,7 @@ PUBLIC struct builtin seccomp_arch_add_struct = {
 
 int seccomp_arch_remove_builtin(WORD_LIST *list)
 {
-    return seccomp_arch_template_builtin(list, "seccomp_arch_remove", 0);
+    return seccomp_arch_template_builtin(list, "seccomp_arch_remove", seccomp_arch_remove_index, 0);
 }
 PUBLIC struct builtin seccomp_arch_remove_struct = {
     "seccomp_arch_remove",       /* builtin name */
@@ -1611,7 +1954,7 @@ PUBLIC struct builtin seccomp_arch_remove_struct = {
 
 int seccomp_arch_exist_builtin(WORD_LIST *list)
 {
-    return seccomp_arch_template_builtin(list, "seccomp_arch_exist", 1);
+    return seccomp_arch_template_builtin(list, "seccomp_arch_exist", seccomp_arch_exist_index, 1);
 }
 PUBLIC struct builtin seccomp_arch_exist_struct = {
     "seccomp_arch_exist",       /* builtin name */
@@ -1627,6 +1970,32 @@ PUBLIC struct builtin seccomp_arch_exist_struct = {
     0                             /* reserved for internal use */
 };
 
+/**
+ * @return 0 on success, -1 on failure and print err msg to stderr.
+ */
+int parse_attr(const char *arg, const char *val_arg, enum scmp_filter_attr *attr, uint32_t *val,
+               const char *fname)
+{
+    if (LOOKUP(seccomp_attr, arg, attr) == -1) {
+        warnx("%s: Unknown attr", fname);
+        return -1;
+    }
+
+    if (strcmp(val_arg, "1") == 0)
+        *val = 1;
+    else if (strcmp(val_arg, "0") == 0)
+        *val = 0;
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 5)
+    else if (strcmp(val_arg, "2") == 0 && *attr == SCMP_FLTATR_CTL_OPTIMIZE)
+        *val = 2;
+#endif
+    else {
+        warnx("%s: Unknown val", fname);
+        return -1;
+    }
+
+    return 0;
+}
 int seccomp_attr_set_builtin(WORD_LIST *list)
 {
     const char *self_name = "seccomp_attr_set";
@@ -1640,30 +2009,13 @@ int seccomp_attr_set_builtin(WORD_LIST *list)
         return (EX_USAGE);
 
     enum scmp_filter_attr attr;
-    if (strcasecmp(argv[0], "CTL_NO_NEW_PRIVS") == 0)
-        attr = SCMP_FLTATR_CTL_NNP;
-    else if (strcasecmp(argv[0], "CTL_TSYNC") == 0)
-        attr = SCMP_FLTATR_CTL_TSYNC;
-    else if (strcasecmp(argv[0], "CTL_LOG") == 0)
-        attr = SCMP_FLTATR_CTL_LOG;
-    else {
-        warnx("%s: Unknown attr", self_name);
-        return (EX_USAGE);
-    }
-
     uint32_t val;
-    if (strcmp(argv[1], "1") == 0)
-        val = 1;
-    else if (strcmp(argv[1], "0") == 0)
-        val = 0;
-    else {
-        warnx("%s: Unknown val", self_name);
+    if (parse_attr(argv[0], argv[1], &attr, &val, self_name) == -1)
         return (EX_USAGE);
-    }
 
     CHECK_SECCOMP_CTX_NOT_NULL();
 
-    seccomp_attr_set_t seccomp_attr_set_p = load_libseccomp_sym(self_name);
+    seccomp_attr_set_t seccomp_attr_set_p = load_libseccomp_sym(seccomp_attr_set);
     int result = seccomp_attr_set_p(seccomp_ctx, attr, val);
     if (result != 0) {
         errno = -result;
@@ -1686,118 +2038,1265 @@ PUBLIC struct builtin seccomp_attr_set_struct = {
         "              Defalt to 0.",
         " - CTL_LOG: set to 1 to log all not allowed syscalls.",
         "              Defalt to 0.",
+        " - CTL_OPTIMIZE: set to 2 to generate the filter as a binary tree, which makes the cost of",
+        "              each syscall logarithmic to the number of rules, but ignores the priorities.",
+        "              Set to 1 to order the filter by seccomp_syscall_priority (the default).",
+        "              Requires libseccomp >= 2.5.0.",
         (char*) NULL
     },                            /* array of long documentation strings. */
     "seccomp_attr_set attr val",
     0                             /* reserved for internal use */
 };
 
-int seccomp_syscall_priority_builtin(WORD_LIST *list)
+/**
+ * @return 0 on success, -1 on failure and print err msg to stderr.
+ */
+int parse_priority(const char *arg, uint8_t *priority, const char *fname, size_t i)
 {
-    const char *self_name = "seccomp_syscall_priority";
-    typedef int (*seccomp_syscall_priority_t)(scmp_filter_ctx, int syscall, uint8_t priority);
+    intmax_t num;
+    if (legal_number(arg, &num) == 0) {
+        warnx("%s: %zu arg %s", fname, i + 1, "need to be a number");
+        return -1;
+    } else if (num > UINT8_MAX || num < 0) {
+        warnx("%s: %zu arg %s", fname, i + 1, "is out of range");
+        return -1;
+    }
 
-    uint32_t arch;
+    *priority = num;
+
+    return 0;
+}
+int seccomp_syscall_priority_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_syscall_priority";
+    typedef int (*seccomp_syscall_priority_t)(scmp_filter_ctx, int syscall, uint8_t priority);
+
+    uint32_t arch;
+    {
+        int result = get_arch(&list, &arch, self_name);
+        if (result != (EXECUTION_SUCCESS))
+            return result;
+    }
+
+    int syscall_number;
+    uint8_t priority;
+    {
+        const char* argv[2];
+        if (to_argv(list, 2, argv) == -1)
+            return (EX_USAGE);
+ 
+        int result = seccomp_resolve_syscall(arch, argv[0], &syscall_number, 0, self_name);
+        if (result != (EXECUTION_SUCCESS))
+            return result;
+        
+        if (parse_priority(argv[1], &priority, self_name, 1) == -1) {
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+
+    CHECK_SECCOMP_CTX_NOT_NULL();
+
+    seccomp_syscall_priority_t seccomp_syscall_priority_p = load_libseccomp_sym(seccomp_syscall_priority);
+    int result = seccomp_syscall_priority_p(seccomp_ctx, syscall_number, priority);
+    
+    if (result != 0) {
+        errno = -result;
+        warn("%s failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin seccomp_syscall_priority_struct = {
+    "seccomp_syscall_priority",       /* builtin name */
+    seccomp_syscall_priority_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_syscall_priority set priority of syscall on arch (default to native) to priority.\n",
+        "Filters for syscalls with higher priority will be placed earlier in the seccomp filter code",
+        "so that they incur less overhead at the expense of syscalls with lower priority.\n",
+        "User can set syscall priority prior to seccomp_rule_add.",
+        "",
+        "Check 'help seccomp_profile_start' for setting the priorities from a profile of the workload.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_syscall_priority [-a arch] syscall_name uint8_t:priority",
+    0                             /* reserved for internal use */
+};
+
+void assoc_insert_uint64(HASH_TABLE *hash, const char *key, uint64_t val)
+{
+    char buffer[sizeof(STR(UINT64_MAX))];
+    snprintf(buffer, sizeof(buffer), "%" PRIu64, val);
+    assoc_insert(hash, savestring(key), buffer);
+}
+/**
+ * Syscall profiler used by seccomp_profile_start and seccomp_profile_apply.
+ *
+ * The profiled process installs a filter returning SECCOMP_RET_USER_NOTIF for every syscall.
+ * The supervisor, a sibling process that shares its fd table until it gets the listener,
+ * tallies every notification into a shared mapping and lets the syscall continue with
+ * SECCOMP_USER_NOTIF_FLAG_CONTINUE, so each invocation is counted once, whether it blocks
+ * or not.
+ */
+#define SECCOMP_PROFILE_NSYSCALLS 1024
+
+struct seccomp_profile {
+    uint32_t arch;      // AUDIT_ARCH_* of syscalls to count
+    size_t notif_size;
+    pid_t pid;          // pid of the profiled process
+    int listener;       // -1 until the filter is installed, -2 if it fails
+    int error;          // errno of the failure
+    uint64_t tally[SECCOMP_PROFILE_NSYSCALLS];
+};
+
+static struct seccomp_profile *seccomp_profile;
+
+size_t get_seccomp_notif_size(const char *fname);
+
+/**
+ * Close every fd except keep.
+ */
+void seccomp_profile_close_fds(int keep)
+{
+#ifdef SYS_close_range
+    if ((keep == 0 || syscall(SYS_close_range, 0, keep - 1, 0) == 0) &&
+        syscall(SYS_close_range, keep + 1, ~0U, 0) == 0)
+        return;
+#endif
+
+    for (int fd = 0, max = sysconf(_SC_OPEN_MAX); fd < max; ++fd) {
+        if (fd != keep)
+            close(fd);
+    }
+}
+/**
+ * Entry of the supervisor, which shares the fd table of the profiled process until it
+ * gets the listener.
+ */
+int seccomp_profile_supervise(void *arg)
+{
+    struct seccomp_profile *profile = arg;
+
+    // It runs a copy of bash, so signal handlers of bash must not run in it.
+    sigset_t all;
+    sigfillset(&all);
+    sigprocmask(SIG_SETMASK, &all, NULL);
+
+    // The profiled process cannot make any syscall to tell the listener, so check it
+    // periodically.
+    const struct timespec req = { .tv_nsec = 100000 };
+    int listener;
+    while ((listener = __atomic_load_n(&profile->listener, __ATOMIC_ACQUIRE)) == -1) {
+        if (kill(profile->pid, 0) == -1 && errno == ESRCH)
+            _exit(1);
+        nanosleep(&req, NULL);
+    }
+    if (listener < 0)
+        _exit(1);
+
+    // Do not keep fds of the profiled process open, e.g. the write end of a pipe whose
+    // reader waits for EOF.
+    // Every syscall of the profiled process blocks until it is continued below, so it
+    // cannot change the fd table meanwhile.
+    if (unshare(CLONE_FILES) == 0)
+        seccomp_profile_close_fds(listener);
+
+    // Use uint64_t for alignment of struct seccomp_notif.
+    uint64_t buffer[(profile->notif_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    struct seccomp_notif *req_notif = (struct seccomp_notif*) buffer;
+
+    for (; ; ) {
+        // POLLHUP is reported once every process using the filter has exited.
+        struct pollfd pollfd = { .fd = listener, .events = POLLIN };
+        if (poll(&pollfd, 1, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            _exit(1);
+        }
+        if (!(pollfd.revents & POLLIN))
+            _exit(0);
+
+        // The kernel requires the buffer to be zeroed.
+        memset(buffer, 0, sizeof(buffer));
+        if (ioctl(listener, SECCOMP_IOCTL_NOTIF_RECV, req_notif) == -1) {
+            if (errno == EINTR || errno == ENOENT)
+                continue;
+            _exit(1);
+        }
+
+        int nr = req_notif->data.nr;
+        if (req_notif->data.arch == profile->arch && nr >= 0 && nr < SECCOMP_PROFILE_NSYSCALLS)
+            ++profile->tally[nr];
+
+        struct seccomp_notif_resp resp = {
+            .id = req_notif->id,
+            .flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE,
+        };
+        while (ioctl(listener, SECCOMP_IOCTL_NOTIF_SEND, &resp) == -1 && errno == EINTR)
+            ;
+    }
+}
+/**
+ * Starts the supervisor and installs the filter reporting every syscall of this process
+ * to it.
+ *
+ * @return 0 on success, -1 on failure with profile->error set.
+ */
+int seccomp_profile_install(struct seccomp_profile *profile)
+{
+    profile->pid = getpid();
+
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+        goto fail;
+
+    char stack[16384];
+    if (clone(seccomp_profile_supervise, STACK(stack, sizeof(stack)), CLONE_FILES | CLONE_PARENT | SIGCHLD,
+              profile) == -1)
+        goto fail;
+
+    struct sock_filter filter[] = {
+        BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF),
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(filter) / sizeof(filter[0]),
+        .filter = filter
+    };
+    long listener = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+    if (listener == -1)
+        goto fail;
+
+    // From now on every syscall blocks until the supervisor handles it.
+    __atomic_store_n(&profile->listener, (int) listener, __ATOMIC_RELEASE);
+    close(listener);
+
+    return 0;
+
+fail:
+    profile->error = errno;
+    __atomic_store_n(&profile->listener, -2, __ATOMIC_RELEASE);
+    return -1;
+}
+void seccomp_profile_release(void)
+{
+    if (seccomp_profile != NULL) {
+        munmap(seccomp_profile, sizeof(struct seccomp_profile));
+        seccomp_profile = NULL;
+    }
+}
+
+int seccomp_profile_start_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_profile_start";
+    typedef uint32_t (*seccomp_arch_native_t)();
+
+    if (check_no_options(&list) == -1)
+        return (EX_USAGE);
+
+    const char *varname = NULL;
+    if (to_argv_opt(list, 0, 1, &varname) == -1)
+        return (EX_USAGE);
+
+    if (seccomp_profile != NULL) {
+        warnx("%s: %s", self_name, "profiling is already started, call seccomp_profile_apply first");
+        return (EXECUTION_FAILURE);
+    }
+
+    seccomp_arch_native_t seccomp_arch_native_p = load_libseccomp_sym(seccomp_arch_native);
+
+    size_t notif_size = get_seccomp_notif_size(self_name);
+    if (notif_size == 0)
+        return (EXECUTION_FAILURE);
+    if (notif_size < sizeof(struct seccomp_notif))
+        notif_size = sizeof(struct seccomp_notif);
+
+    struct seccomp_profile *profile = mmap(NULL, sizeof(struct seccomp_profile),
+                                           PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (profile == MAP_FAILED) {
+        warn("%s: mmap failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+    profile->arch = seccomp_arch_native_p();
+    profile->notif_size = notif_size;
+    profile->listener = -1;
+
+    // Closed by the child once the filter is installed or fails to be.
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1) {
+        warn("%s: pipe2 failed", self_name);
+        munmap(profile, sizeof(struct seccomp_profile));
+        return (EXECUTION_FAILURE);
+    }
+
+    pid_t pid = fork();
+    if (pid == -1) {
+        warn("%s: fork failed", self_name);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        munmap(profile, sizeof(struct seccomp_profile));
+        return (EXECUTION_FAILURE);
+    } else if (pid == 0) {
+        close(pipefd[0]);
+        int result = seccomp_profile_install(profile);
+        close(pipefd[1]);
+        if (result == -1)
+            _exit(EXECUTION_FAILURE);
+
+        munmap(profile, sizeof(struct seccomp_profile));
+        if (varname)
+            bind_var_to_int((char*) varname, 0);
+        return (EXECUTION_SUCCESS);
+    }
+
+    close(pipefd[1]);
+    char c;
+    while (read(pipefd[0], &c, 1) == -1 && errno == EINTR)
+        ;
+    close(pipefd[0]);
+
+    if (profile->listener < 0) {
+        errno = profile->error;
+        warn("%s: installing the filter failed", self_name);
+        munmap(profile, sizeof(struct seccomp_profile));
+        return (EXECUTION_FAILURE);
+    }
+
+    seccomp_profile = profile;
+    if (varname)
+        bind_var_to_int((char*) varname, pid);
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin seccomp_profile_start_struct = {
+    "seccomp_profile_start",       /* builtin name */
+    seccomp_profile_start_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_profile_start creates a child process, in which every syscall made by it and its",
+        "descendants is counted, until seccomp_profile_apply is called in this process.",
+        "",
+        "If var is present, then the pid is writen to it in this process, and",
+        "0 is writen to it in the child process.",
+        "",
+        "Each syscall is reported to a supervisor process through seccomp user notification and then",
+        "continued by the kernel, so every invocation is counted whether it blocks or not, at the",
+        "cost of a round trip to the supervisor per syscall while profiling.",
+        "",
+        "Since a seccomp filter cannot be removed, the child process should only run the workload",
+        "and exit, e.g.",
+        "",
+        "    seccomp_profile_start pid",
+        "    if [ \"$pid\" -eq 0 ]; then workload; exit; fi",
+        "",
+        "no_new_privs is set in the child process (check 'help enable_no_new_privs_strict').",
+        "Requires Linux 5.5 for continuing syscalls, and 5.8 for the supervisor to exit once every",
+        "profiled process has exited.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_profile_start [var]",
+    0                             /* reserved for internal use */
+};
+
+int seccomp_profile_apply_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_profile_apply";
+    typedef int (*seccomp_syscall_priority_t)(scmp_filter_ctx, int syscall, uint8_t priority);
+    typedef char* (*seccomp_syscall_resolve_num_arch_t)(uint32_t, int);
+
+    if (check_no_options(&list) == -1)
+        return (EX_USAGE);
+
+    const char *varname = NULL;
+    if (to_argv_opt(list, 0, 1, &varname) == -1)
+        return (EX_USAGE);
+
+    if (seccomp_profile == NULL) {
+        warnx("%s: %s", self_name, "seccomp_profile_start is not called");
+        return (EXECUTION_FAILURE);
+    }
+
+    CHECK_SECCOMP_CTX_NOT_NULL();
+
+    seccomp_syscall_priority_t seccomp_syscall_priority_p = load_libseccomp_sym(seccomp_syscall_priority);
+    seccomp_syscall_resolve_num_arch_t resolver_p = NULL;
+    if (varname != NULL)
+        resolver_p = load_libseccomp_sym(seccomp_syscall_resolve_num_arch);
+
+    // The profiled process may already be reaped by bash.
+    while (waitpid(seccomp_profile->pid, NULL, 0) == -1 && errno == EINTR)
+        QUIT;
+
+    const uint64_t *tally = seccomp_profile->tally;
+
+    uint64_t max = 0;
+    for (size_t nr = 0; nr != SECCOMP_PROFILE_NSYSCALLS; ++nr) {
+        if (tally[nr] > max)
+            max = tally[nr];
+    }
+
+    HASH_TABLE *hash = NULL;
+    if (varname != NULL)
+        hash = assoc_cell(make_new_assoc_variable((char*) varname));
+
+    int ret = (EXECUTION_SUCCESS);
+    for (size_t nr = 0; nr != SECCOMP_PROFILE_NSYSCALLS; ++nr) {
+        uint64_t cnt = tally[nr];
+        if (cnt == 0)
+            continue;
+
+        // Scale to 1..255, so that every syscall seen is placed before those never seen.
+        uint8_t priority = 1 + (uint8_t) ((UINT8_MAX - 1) * cnt / max);
+
+        int result = seccomp_syscall_priority_p(seccomp_ctx, nr, priority);
+        if (result != 0) {
+            errno = -result;
+            warn("%s: seccomp_syscall_priority on syscall %zu failed", self_name, nr);
+            ret = (EXECUTION_FAILURE);
+        }
+
+        if (hash != NULL) {
+            char *name = resolver_p(SCMP_ARCH_NATIVE, nr);
+            char key[sizeof(STR(SECCOMP_PROFILE_NSYSCALLS))];
+            if (name == NULL)
+                snprintf(key, sizeof(key), "%zu", nr);
+
+            assoc_insert_uint64(hash, name != NULL ? name : key, cnt);
+            (free)(name);
+        }
+    }
+
+    seccomp_profile_release();
+
+    return ret;
+}
+PUBLIC struct builtin seccomp_profile_apply_struct = {
+    "seccomp_profile_apply",       /* builtin name */
+    seccomp_profile_apply_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_profile_apply waits for the child process created by seccomp_profile_start to exit",
+        "and sets the priority of every syscall made according to its number of invocations using",
+        "seccomp_syscall_priority, so that hot syscalls are checked first in the filter.",
+        "",
+        "Syscalls made by descendants of the child process still running are not waited for.",
+        "",
+        "Priorities are ignored if CTL_OPTIMIZE is set to 2 (binary tree), so do not combine them:",
+        "use either seccomp_profile_apply or 'seccomp_attr_set CTL_OPTIMIZE 2'.",
+        "",
+        "If var is passed, the number of invocations of each syscall is stored in associative array var.",
+        "",
+        "Priorities only apply to the native arch and must be set before rules are added.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_profile_apply [var]",
+    0                             /* reserved for internal use */
+};
+
+int seccomp_load_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_load";
+    typedef int (*seccomp_load_t)(scmp_filter_ctx);
+
+    if (check_no_options(&list) == -1)
+        return (EX_USAGE);
+
+    if (list != NULL) {
+        builtin_usage();
+        return (EX_USAGE);
+    }
+
+    CHECK_SECCOMP_CTX_NOT_NULL();
+
+    seccomp_load_t seccomp_load_p = load_libseccomp_sym(seccomp_load);
+    int result = seccomp_load_p(seccomp_ctx);
+
+    if (result != 0) {
+        errno = -result;
+        warn("%s failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin seccomp_load_struct = {
+    "seccomp_load",       /* builtin name */
+    seccomp_load_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_load load the filter into kernel.\n",
+        "Unless seccomp_attr_set CTL_NO_NEW_PRIVS 0, otherwise seccomp_load will set NO_NEW_PRIVS before",
+        "loading the filter.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_load",
+    0                             /* reserved for internal use */
+};
+
+struct policy_rule {
+    size_t lineno;
+
+    uint32_t action;
+    int syscall_num;
+
+    unsigned arg_cnt;
+    struct scmp_arg_cmp *arg_cmps;
+};
+struct policy_priority {
+    int syscall_num;
+    uint8_t priority;
+};
+struct policy_attr {
+    enum scmp_filter_attr attr;
+    uint32_t val;
+};
+struct seccomp_policy {
+    int has_def_action;
+    uint32_t def_action;
+
+    size_t narches;
+    uint32_t *arches;
+
+    size_t nattrs;
+    struct policy_attr *attrs;
+
+    size_t npriorities;
+    struct policy_priority *priorities;
+
+    size_t nrules;
+    struct policy_rule *rules;
+
+    size_t ncmps;
+    struct scmp_arg_cmp *cmps;
+};
+
+/**
+ * @return NULL if there isn't any token left in *line.
+ */
+char* next_token(char **line)
+{
+    char *token = *line + strspn(*line, " \t\r");
+    if (*token == '\0') {
+        *line = token;
+        return NULL;
+    }
+
+    char *end = token + strcspn(token, " \t\r");
+    if (*end != '\0')
+        *end++ = '\0';
+    *line = end;
+
+    return token;
+}
+
+void free_seccomp_policy(struct seccomp_policy *policy)
+{
+    (free)(policy->arches);
+    (free)(policy->attrs);
+    (free)(policy->priorities);
+    (free)(policy->rules);
+    (free)(policy->cmps);
+}
+/**
+ * @return 0 on success, -1 on failure.
+ *
+ * Allocates space for the policy in content, which will never require more than one entry per line
+ * and one comparison per line plus one per ','.
+ */
+int alloc_seccomp_policy(struct seccomp_policy *policy, const char *content, const char *fname)
+{
+    size_t nlines = 1;
+    size_t ncommas = 0;
+    for (const char *p = content; *p != '\0'; ++p) {
+        nlines += *p == '\n';
+        ncommas += *p == ',';
+    }
+
+    memset(policy, 0, sizeof(struct seccomp_policy));
+
+    policy->arches = calloc(nlines, sizeof(uint32_t));
+    policy->attrs = calloc(nlines, sizeof(struct policy_attr));
+    policy->priorities = calloc(nlines, sizeof(struct policy_priority));
+    policy->rules = calloc(nlines, sizeof(struct policy_rule));
+    policy->cmps = calloc(nlines + ncommas, sizeof(struct scmp_arg_cmp));
+
+    if (policy->arches == NULL || policy->attrs == NULL || policy->priorities == NULL || 
+        policy->rules == NULL || policy->cmps == NULL) {
+        warn("%s: calloc failed", fname);
+        free_seccomp_policy(policy);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @param where prefix of err msg.
+ * @return EXECUTION_SUCCESS, EX_USAGE or EXECUTION_FAILURE.
+ */
+int parse_policy_rule(char *line, uint32_t arch, struct seccomp_policy *policy, const char *where)
+{
+    struct policy_rule *rule = policy->rules + policy->nrules;
+
+    const char *action = next_token(&line);
+    const char *syscall_name = next_token(&line);
+    if (syscall_name == NULL) {
+        warnx("%s: %s", where, "rule requires action and syscall_name");
+        return (EX_USAGE);
+    }
+
+    if (parse_action_impl(action, &rule->action, where, 1) == -1)
+        return (EX_USAGE);
+
+    int result = seccomp_resolve_syscall(arch, syscall_name, &rule->syscall_num, 2, where);
+    if (result != (EXECUTION_SUCCESS))
+        return result;
+
+    rule->arg_cmps = policy->cmps + policy->ncmps;
+    rule->arg_cnt = 0;
+
+    if (line[strspn(line, " \t\r")] != '\0') {
+        for (char *cmp = line, *next; cmp != NULL; cmp = next) {
+            next = strchr(cmp, ',');
+            if (next != NULL)
+                *next++ = '\0';
+
+            // sscanf in parse_arg_cmp does not skip leading whitespace before 'A'
+            cmp += strspn(cmp, " \t\r");
+            if (*cmp == '\0') {
+                warnx("%s: Empty %u syscall_arg_requirement", where, rule->arg_cnt + 1);
+                return (EX_USAGE);
+            }
+
+            result = parse_arg_cmp(cmp, rule->arg_cmps + rule->arg_cnt, where, 3 + rule->arg_cnt);
+            if (result != (EXECUTION_SUCCESS))
+                return result;
+            ++rule->arg_cnt;
+        }
+    }
+
+    policy->ncmps += rule->arg_cnt;
+    ++policy->nrules;
+
+    return (EXECUTION_SUCCESS);
+}
+/**
+ * @param content would be modified.
+ * @return EXECUTION_SUCCESS, EX_USAGE or EXECUTION_FAILURE.
+ */
+int parse_policy(char *content, uint32_t arch, struct seccomp_policy *policy, const char *path,
+                 const char *fname)
+{
+    char where[PATH_MAX + 64];
+
+    size_t lineno = 0;
+    for (char *line = content, *next; line != NULL; line = next) {
+        ++lineno;
+
+        next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        char *comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+
+        const char *keyword = next_token(&line);
+        if (keyword == NULL)
+            continue;
+
+        snprintf(where, sizeof(where), "%s: %s:%zu", fname, path, lineno);
+
+        int result = (EXECUTION_SUCCESS);
+        if (strcasecmp(keyword, "rule") == 0) {
+            policy->rules[policy->nrules].lineno = lineno;
+            result = parse_policy_rule(line, arch, policy, where);
+            line = "";
+        } else if (strcasecmp(keyword, "default") == 0) {
+            const char *action = next_token(&line);
+            if (policy->has_def_action) {
+                warnx("%s: %s", where, "default is specified twice");
+                result = (EX_USAGE);
+            } else if (action == NULL || parse_action_impl(action, &policy->def_action, where, 1) == -1)
+                result = (EX_USAGE);
+            policy->has_def_action = 1;
+        } else if (strcasecmp(keyword, "arch") == 0) {
+            const char *arch_name = next_token(&line);
+            if (arch_name == NULL)
+                result = (EX_USAGE);
+            else
+                result = resolve_arch(arch_name, policy->arches + policy->narches++, where);
+        } else if (strcasecmp(keyword, "attr") == 0) {
+            const char *attr = next_token(&line);
+            const char *val = next_token(&line);
+            struct policy_attr *p = policy->attrs + policy->nattrs++;
+            if (val == NULL || parse_attr(attr, val, &p->attr, &p->val, where) == -1)
+                result = (EX_USAGE);
+        } else if (strcasecmp(keyword, "priority") == 0) {
+            const char *syscall_name = next_token(&line);
+            const char *priority = next_token(&line);
+            struct policy_priority *p = policy->priorities + policy->npriorities++;
+            if (priority == NULL)
+                result = (EX_USAGE);
+            else {
+                result = seccomp_resolve_syscall(arch, syscall_name, &p->syscall_num, 1, where);
+                if (result == (EXECUTION_SUCCESS) && parse_priority(priority, &p->priority, where, 2) == -1)
+                    result = (EX_USAGE);
+            }
+        } else {
+            warnx("%s: Unknown keyword %s", where, keyword);
+            result = (EX_USAGE);
+        }
+
+        if (result == (EXECUTION_SUCCESS) && next_token(&line) != NULL) {
+            warnx("%s: %s", where, "Too many parameters");
+            result = (EX_USAGE);
+        }
+
+        if (result != (EXECUTION_SUCCESS)) {
+            if (result == (EX_USAGE))
+                warnx("%s: Invalid %s", where, keyword);
+            return result;
+        }
+    }
+
+    if (!policy->has_def_action) {
+        warnx("%s: %s: %s", fname, path, "default action isn't specified");
+        return (EX_USAGE);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+/**
+ * Build a new filter from policy and replace seccomp_ctx with it on success.
+ */
+int build_policy(const struct seccomp_policy *policy, const char *fname)
+{
+    typedef scmp_filter_ctx (*seccomp_init_t)(uint32_t);
+    typedef void (*seccomp_release_t)(scmp_filter_ctx);
+    typedef int (*seccomp_arch_add_t)(scmp_filter_ctx, uint32_t);
+    typedef int (*seccomp_attr_set_t)(scmp_filter_ctx, enum scmp_filter_attr, uint32_t);
+    typedef int (*seccomp_syscall_priority_t)(scmp_filter_ctx, int syscall, uint8_t priority);
+
+    seccomp_init_t seccomp_init_p = load_libseccomp_sym(seccomp_init);
+    seccomp_release_t seccomp_release_p = load_libseccomp_sym(seccomp_release);
+    seccomp_arch_add_t seccomp_arch_add_p = load_libseccomp_sym(seccomp_arch_add);
+    seccomp_attr_set_t seccomp_attr_set_p = load_libseccomp_sym(seccomp_attr_set);
+    seccomp_syscall_priority_t seccomp_syscall_priority_p = load_libseccomp_sym(seccomp_syscall_priority);
+    seccomp_rule_addv_t seccomp_rule_addv_p = load_libseccomp_sym(seccomp_rule_add_array);
+
+    scmp_filter_ctx ctx = seccomp_init_p(policy->def_action);
+    if (ctx == NULL) {
+        warnx("%s: %s failed", fname, "seccomp_init");
+        return (EXECUTION_FAILURE);
+    }
+
+    int result = 0;
+    const char *failed = NULL;
+
+    for (size_t i = 0; i != policy->narches && result == 0; ++i) {
+        result = seccomp_arch_add_p(ctx, policy->arches[i]);
+        if (result == -EEXIST)
+            result = 0;
+        failed = "seccomp_arch_add";
+    }
+
+    for (size_t i = 0; i != policy->nattrs && result == 0; ++i) {
+        result = seccomp_attr_set_p(ctx, policy->attrs[i].attr, policy->attrs[i].val);
+        failed = "seccomp_attr_set";
+    }
+
+    for (size_t i = 0; i != policy->npriorities && result == 0; ++i) {
+        const struct policy_priority *p = policy->priorities + i;
+        result = seccomp_syscall_priority_p(ctx, p->syscall_num, p->priority);
+        failed = "seccomp_syscall_priority";
+    }
+
+    for (size_t i = 0; i != policy->nrules && result == 0; ++i) {
+        const struct policy_rule *rule = policy->rules + i;
+        result = seccomp_rule_addv_p(ctx, rule->action, rule->syscall_num, rule->arg_cnt, rule->arg_cmps);
+        if (result != 0) {
+            errno = -result;
+            warn("%s: %s failed on rule at line %zu", fname, "seccomp_rule_add_array", rule->lineno);
+            seccomp_release_p(ctx);
+            return (EXECUTION_FAILURE);
+        }
+    }
+
+    if (result != 0) {
+        errno = -result;
+        warn("%s: %s failed", fname, failed);
+        seccomp_release_p(ctx);
+        return (EXECUTION_FAILURE);
+    }
+
+    if (seccomp_ctx != NULL)
+        seccomp_release_p(seccomp_ctx);
+    seccomp_ctx = ctx;
+
+    return (EXECUTION_SUCCESS);
+}
+int seccomp_load_policy_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_load_policy";
+
+    uint32_t arch;
     {
         int result = get_arch(&list, &arch, self_name);
         if (result != (EXECUTION_SUCCESS))
             return result;
     }
 
-    int syscall_number;
-    uint8_t priority;
-    {
-        const char* argv[2];
-        if (to_argv(list, 2, argv) == -1)
-            return (EX_USAGE);
- 
-        int result = seccomp_resolve_syscall(arch, argv[0], &syscall_number, 0, self_name);
-        if (result != (EXECUTION_SUCCESS))
-            return result;
-        
-        intmax_t num;
-        if (legal_number(argv[1], &num) == 0) {
-            warnx("%s: 2 arg %s", self_name, "need to be a number");
-            builtin_usage();
+    const char *path;
+    if (to_argv(list, 1, &path) == -1)
+        return (EX_USAGE);
+
+    size_t len;
+    char *content = read_whole_file_at(path, &len, self_name);
+    if (content == NULL)
+        return (EXECUTION_FAILURE);
+
+    int ret;
+
+    struct seccomp_policy policy;
+    if (alloc_seccomp_policy(&policy, content, self_name) == -1) {
+        ret = (EXECUTION_FAILURE);
+        goto free_content;
+    }
+
+    ret = parse_policy(content, arch, &policy, path, self_name);
+    if (ret == (EXECUTION_SUCCESS))
+        ret = build_policy(&policy, self_name);
+
+    free_seccomp_policy(&policy);
+
+free_content:
+    (free)(content);
+
+    return ret;
+}
+PUBLIC struct builtin seccomp_load_policy_struct = {
+    "seccomp_load_policy",       /* builtin name */
+    seccomp_load_policy_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_load_policy parses and validates the whole policy file, then builds the seccomp filter",
+        "from it in one go, replacing the filter created by seccomp_init.",
+        "",
+        "If any line of the policy is invalid, the existing filter is left untouched.",
+        "",
+        "The policy file is line based, '#' starts a comment and empty lines are ignored:",
+        "",
+        " - \"default action\": default action for syscalls where there isn't a rule for (required).",
+        " - \"arch arch\": add arch to the filter, same as seccomp_arch_add.",
+        " - \"attr attr val\": same as seccomp_attr_set.",
+        " - \"priority syscall_name uint8_t:priority\": same as seccomp_syscall_priority.",
+        " - \"rule action syscall_name [syscall_arg_requirements, ...]\": same as seccomp_rule_add,",
+        "   except that syscall_arg_requirements are separated by ','.",
+        "",
+        "Syscall names are resolved on arch specified by -a, which defaults to native.",
+        "Check 'help seccomp_init' and 'help seccomp_rule_add' for format of action and",
+        "syscall_arg_requirements.",
+        "",
+        "Example policy:",
+        "",
+        "    default ERRNO:EPERM",
+        "    priority read 255",
+        "    rule ALLOW read",
+        "    rule ALLOW write A0_32 == 1, A2_64 <= 4096",
+        "",
+        "NOTE that seccomp_load still needs to be called to load the filter into kernel.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_load_policy [-a arch] policy_file",
+    0                             /* reserved for internal use */
+};
+
+int seccomp_notify_fd_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_notify_fd";
+    typedef int (*seccomp_notify_fd_t)(const scmp_filter_ctx);
+
+    if (check_no_options(&list) == -1)
+        return (EX_USAGE);
+
+    const char *varname;
+    if (to_argv(list, 1, &varname) == -1)
+        return (EX_USAGE);
+
+    CHECK_SECCOMP_CTX_NOT_NULL();
+
+    seccomp_notify_fd_t seccomp_notify_fd_p = load_libseccomp_sym(seccomp_notify_fd);
+    int fd = seccomp_notify_fd_p(seccomp_ctx);
+    if (fd < 0) {
+        errno = -fd;
+        warn("%s failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+
+    bind_var_to_int((char*) varname, fd);
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin seccomp_notify_fd_struct = {
+    "seccomp_notify_fd",       /* builtin name */
+    seccomp_notify_fd_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_notify_fd stores the fd for receiving notification of syscalls matching rules with",
+        "action NOTIFY in $var.",
+        "",
+        "It must be called after seccomp_load.",
+        "",
+        "The fd becomes readable when a notification is pending, so it can be polled along with other",
+        "fds, and it can be passed to the supervisor process via sendfds.",
+        "",
+        "Check 'help seccomp_notify_recv' for how to handle the notifications.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_notify_fd var",
+    0                             /* reserved for internal use */
+};
+
+/**
+ * @return size of struct seccomp_notif used by the running kernel, 0 on failure.
+ */
+size_t get_seccomp_notif_size(const char *fname)
+{
+    static struct seccomp_notif_sizes sizes;
+
+    if (sizes.seccomp_notif == 0) {
+        if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) == -1) {
+            warn("%s: seccomp(SECCOMP_GET_NOTIF_SIZES) failed", fname);
+            return 0;
+        }
+    }
+
+    return sizes.seccomp_notif;
+}
+/**
+ * @return 0 on success, -1 on failure.
+ */
+int readin_notif_id(const char *arg, __u64 *id, const char *fname)
+{
+    uint64_t val;
+    if (str2uint64(arg, &val) != 0) {
+        warnx("%s: Invalid notification id %s", fname, arg);
+        builtin_usage();
+        return -1;
+    }
+    *id = val;
+    return 0;
+}
+int seccomp_notify_recv_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_notify_recv";
+    typedef char* (*seccomp_syscall_resolve_num_arch_t)(uint32_t, int);
+
+    int resolve_name = PARSE_FLAG(&list, "N", 1);
+
+    const char *argv[2];
+    if (to_argv(list, 2, argv) == -1)
+        return (EX_USAGE);
+
+    int fd;
+    if (str2fd(argv[0], &fd) == -1)
+        return (EX_USAGE);
+
+    seccomp_syscall_resolve_num_arch_t resolver_p = NULL;
+    if (resolve_name)
+        resolver_p = load_libseccomp_sym(seccomp_syscall_resolve_num_arch);
+
+    size_t notif_size = get_seccomp_notif_size(self_name);
+    if (notif_size == 0)
+        return (EXECUTION_FAILURE);
+    if (notif_size < sizeof(struct seccomp_notif))
+        notif_size = sizeof(struct seccomp_notif);
+
+    // Use uint64_t for alignment of struct seccomp_notif.
+    uint64_t buffer[(notif_size + sizeof(uint64_t) - 1) / sizeof(uint64_t)];
+    struct seccomp_notif *req = (struct seccomp_notif*) buffer;
+
+    int result;
+    do {
+        // The kernel requires the buffer to be zeroed.
+        memset(buffer, 0, sizeof(buffer));
+        result = ioctl(fd, SECCOMP_IOCTL_NOTIF_RECV, req);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+        if (errno == ENOENT)
+            return 3;
+        warn("%s: ioctl(SECCOMP_IOCTL_NOTIF_RECV) failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+
+    HASH_TABLE *hash = assoc_cell(make_new_assoc_variable((char*) argv[1]));
+
+    assoc_insert_uint64(hash, "id", req->id);
+    assoc_insert_uint64(hash, "pid", req->pid);
+    assoc_insert_uint64(hash, "flags", req->flags);
+    assoc_insert_uint64(hash, "nr", req->data.nr);
+    assoc_insert_uint64(hash, "arch", req->data.arch);
+    assoc_insert_uint64(hash, "instruction_pointer", req->data.instruction_pointer);
+
+    char key[] = "arg0";
+    for (int i = 0; i != 6; ++i) {
+        key[3] = '0' + i;
+        assoc_insert_uint64(hash, key, req->data.args[i]);
+    }
+
+    if (resolver_p != NULL) {
+        char *name = resolver_p(req->data.arch, req->data.nr);
+        if (name != NULL) {
+            assoc_insert(hash, savestring("syscall"), name);
+            (free)(name);
+        }
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin seccomp_notify_recv_struct = {
+    "seccomp_notify_recv",       /* builtin name */
+    seccomp_notify_recv_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_notify_recv waits for a notification on fd obtained by seccomp_notify_fd and stores",
+        "it in associative array var, with keys:",
+        " - id: id of the notification, to be passed to seccomp_notify_respond.",
+        " - pid: pid of the process that made the syscall.",
+        " - nr: syscall number.",
+        " - arch: AUDIT_ARCH_* value of the syscall.",
+        " - instruction_pointer",
+        " - arg0 ... arg5: arguments of the syscall.",
+        " - syscall: name of the syscall, only present if '-N' is passed.",
+        "",
+        "The process making the syscall is blocked until seccomp_notify_respond is called.",
+        "",
+        "Since pointers in args refer to memory of the target process, which can be changed after",
+        "they are read, use seccomp_notify_id_valid after reading /proc/pid/mem to ensure the target",
+        "is still waiting for the response.",
+        "",
+        "Returns 3 if the target process is killed before the notification can be received.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_notify_recv [-N] <int> fd var",
+    0                             /* reserved for internal use */
+};
+
+int seccomp_notify_respond_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_notify_respond";
+
+    unsigned flags = PARSE_FLAG(&list, "C", SECCOMP_USER_NOTIF_FLAG_CONTINUE);
+
+    const char *argv[3];
+    int opt_argc = to_argv_opt(list, 2, 1, argv);
+    if (opt_argc == -1)
+        return (EX_USAGE);
+
+    int fd;
+    if (str2fd(argv[0], &fd) == -1)
+        return (EX_USAGE);
+
+    struct seccomp_notif_resp resp = {
+        .flags = flags
+    };
+
+    if (readin_notif_id(argv[1], &resp.id, self_name) == -1)
+        return (EX_USAGE);
+
+    if (opt_argc == 1) {
+        intmax_t val;
+
+        if (flags & SECCOMP_USER_NOTIF_FLAG_CONTINUE) {
+            warnx("%s: %s", self_name, "'-C' cannot be used with return value");
+            return (EX_USAGE);
+        } else if (strncasecmp(argv[2], "ERRNO:", 6) == 0) {
+            int errno_v = parse_errno(argv[2] + 6, 3, self_name);
+            if (errno_v == -1) {
+                builtin_usage();
+                return (EX_USAGE);
+            }
+            resp.error = -errno_v;
+        } else if (legal_number(argv[2], &val) != 0)
+            resp.val = val;
+        else {
+            warnx("%s: Invalid %d arg", self_name, 3);
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+
+    int result;
+    do {
+        result = ioctl(fd, SECCOMP_IOCTL_NOTIF_SEND, &resp);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+        if (errno == ENOENT)
+            return 3;
+        warn("%s: ioctl(SECCOMP_IOCTL_NOTIF_SEND) failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+
+    return (EXECUTION_SUCCESS);
+}
+PUBLIC struct builtin seccomp_notify_respond_struct = {
+    "seccomp_notify_respond",       /* builtin name */
+    seccomp_notify_respond_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_notify_respond responds to notification id received by seccomp_notify_recv.",
+        "",
+        "If 'ERRNO:errno' is passed, then the syscall fails with errno.",
+        "If an integer is passed, then the syscall returns the integer without being executed.",
+        "If neither is passed, then the syscall returns 0 without being executed.",
+        "",
+        "If '-C' is passed, then the syscall is executed by the kernel as if there is no filter.",
+        "NOTE that '-C' must be used with caution: since the target can change the memory its args",
+        "point to after the check, it cannot be used to implement security policy.",
+        "",
+        "Returns 3 if the target process is killed or its syscall is interrupted by a signal.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_notify_respond [-C] <int> fd id [ERRNO:errno/<int64_t> val]",
+    0                             /* reserved for internal use */
+};
+
+int seccomp_notify_addfd_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_notify_addfd";
+
+    struct seccomp_notif_addfd addfd = { 0 };
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "sCt:")) != -1; ) {
+        switch (opt) {
+        case 's':
+#ifdef SECCOMP_ADDFD_FLAG_SEND
+            addfd.flags |= SECCOMP_ADDFD_FLAG_SEND;
+            break;
+#else
+            warnx("%s: %s", self_name, "'-s' isn't supported by the kernel headers this is built with");
             return (EX_USAGE);
-        } else if (result > UINT8_MAX || result < 0) {
-            warnx("%s: 2 arg %s", self_name, "is out of range");
+#endif
+
+        case 'C':
+            addfd.newfd_flags |= O_CLOEXEC;
+            break;
+
+        case 't':
+            if (str2fd(list_optarg, (int*) &addfd.newfd) == -1)
+                return (EX_USAGE);
+            addfd.flags |= SECCOMP_ADDFD_FLAG_SETFD;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
             builtin_usage();
             return (EX_USAGE);
         }
- 
-        priority = num;
     }
+    list = loptend;
 
-    CHECK_SECCOMP_CTX_NOT_NULL();
+    const char *argv[4];
+    int opt_argc = to_argv_opt(list, 3, 1, argv);
+    if (opt_argc == -1)
+        return (EX_USAGE);
 
-    seccomp_syscall_priority_t seccomp_syscall_priority_p = load_libseccomp_sym(self_name);
-    int result = seccomp_syscall_priority_p(seccomp_ctx, syscall_number, priority);
-    
-    if (result != 0) {
-        errno = -result;
-        warn("%s failed", self_name);
+    int fd;
+    if (str2fd(argv[0], &fd) == -1)
+        return (EX_USAGE);
+
+    if (readin_notif_id(argv[1], &addfd.id, self_name) == -1)
+        return (EX_USAGE);
+
+    if (str2fd(argv[2], (int*) &addfd.srcfd) == -1)
+        return (EX_USAGE);
+
+    int result;
+    do {
+        result = ioctl(fd, SECCOMP_IOCTL_NOTIF_ADDFD, &addfd);
+    } while (result == -1 && errno == EINTR);
+
+    if (result == -1) {
+        if (errno == ENOENT)
+            return 3;
+        warn("%s: ioctl(SECCOMP_IOCTL_NOTIF_ADDFD) failed", self_name);
         return (EXECUTION_FAILURE);
     }
 
+    if (opt_argc == 1)
+        bind_var_to_int((char*) argv[3], result);
+
     return (EXECUTION_SUCCESS);
 }
-PUBLIC struct builtin seccomp_syscall_priority_struct = {
-    "seccomp_syscall_priority",       /* builtin name */
-    seccomp_syscall_priority_builtin, /* function implementing the builtin */
+PUBLIC struct builtin seccomp_notify_addfd_struct = {
+    "seccomp_notify_addfd",       /* builtin name */
+    seccomp_notify_addfd_builtin, /* function implementing the builtin */
     BUILTIN_ENABLED,               /* initial flags for builtin */
     (char*[]){
-        "seccomp_syscall_priority set priority of syscall on arch (default to native) to priority.\n",
-        "Filters for syscalls with higher priority will be placed earlier in the seccomp filter code",
-        "so that they incur less overhead at the expense of syscalls with lower priority.\n",
-        "User can set syscall priority prior to seccomp_rule_add.",
+        "seccomp_notify_addfd installs srcfd of this process into the target process of notification id,",
+        "and stores the fd number in the target process in $var.",
+        "",
+        "If '-t targetfd' is passed, srcfd is installed as targetfd in the target process.",
+        "If '-C' is passed, the installed fd is marked close-on-exec.",
+        "If '-s' is passed, the fd number is also returned to the target as the result of the syscall",
+        "atomically (e.g. for brokering openat), so seccomp_notify_respond is not needed.",
+        "",
+        "Returns 3 if the target process is killed or its syscall is interrupted by a signal.",
         (char*) NULL
     },                            /* array of long documentation strings. */
-    "seccomp_syscall_priority [-a arch] syscall_name uint8_t:priority",
+    "seccomp_notify_addfd [-sC] [-t <int> targetfd] <int> fd id <int> srcfd [var]",
     0                             /* reserved for internal use */
 };
 
-int seccomp_load_builtin(WORD_LIST *list)
+int seccomp_notify_id_valid_builtin(WORD_LIST *list)
 {
-    const char *self_name = "seccomp_load";
-    typedef int (*seccomp_load_t)(scmp_filter_ctx);
+    const char *self_name = "seccomp_notify_id_valid";
 
     if (check_no_options(&list) == -1)
         return (EX_USAGE);
 
-    if (list != NULL) {
-        builtin_usage();
+    const char *argv[2];
+    if (to_argv(list, 2, argv) == -1)
         return (EX_USAGE);
-    }
 
-    CHECK_SECCOMP_CTX_NOT_NULL();
+    int fd;
+    if (str2fd(argv[0], &fd) == -1)
+        return (EX_USAGE);
 
-    seccomp_load_t seccomp_load_p = load_libseccomp_sym(self_name);
-    int result = seccomp_load_p(seccomp_ctx);
+    __u64 id;
+    if (readin_notif_id(argv[1], &id, self_name) == -1)
+        return (EX_USAGE);
 
-    if (result != 0) {
-        errno = -result;
-        warn("%s failed", self_name);
+    if (ioctl(fd, SECCOMP_IOCTL_NOTIF_ID_VALID, &id) == -1) {
+        if (errno == ENOENT)
+            return 3;
+        warn("%s: ioctl(SECCOMP_IOCTL_NOTIF_ID_VALID) failed", self_name);
         return (EXECUTION_FAILURE);
     }
 
     return (EXECUTION_SUCCESS);
 }
-PUBLIC struct builtin seccomp_load_struct = {
-    "seccomp_load",       /* builtin name */
-    seccomp_load_builtin, /* function implementing the builtin */
+PUBLIC struct builtin seccomp_notify_id_valid_struct = {
+    "seccomp_notify_id_valid",       /* builtin name */
+    seccomp_notify_id_valid_builtin, /* function implementing the builtin */
     BUILTIN_ENABLED,               /* initial flags for builtin */
     (char*[]){
-        "seccomp_load load the filter into kernel.\n",
-        "Unless seccomp_attr_set CTL_NO_NEW_PRIVS 0, otherwise seccomp_load will set NO_NEW_PRIVS before",
-        "loading the filter.",
+        "seccomp_notify_id_valid checks whether the target of notification id is still waiting for",
+        "the response.",
+        "",
+        "Returns 0 if it is still valid, 3 if not.",
         (char*) NULL
     },                            /* array of long documentation strings. */
-    "seccomp_load",
+    "seccomp_notify_id_valid <int> fd id",
     0                             /* reserved for internal use */
 };
 
-int seccomp_export_template_builtin(WORD_LIST *list, const char *fname)
+int seccomp_export_template_builtin(WORD_LIST *list, const char *fname, size_t sym_index)
 {
     typedef int (*fp)(const scmp_filter_ctx, int fd);
 
@@ -1816,7 +3315,9 @@ int seccomp_export_template_builtin(WORD_LIST *list, const char *fname)
 
     CHECK_SECCOMP_CTX_NOT_NULL();
 
-    fp f = load_libseccomp_sym(fname);
+    fp f = load_sym(&libseccomp, sym_index);
+    if (f == NULL)
+        return (EXECUTION_FAILURE);
     int result = f(seccomp_ctx, fd);
 
     if (result != 0) {
@@ -1829,7 +3330,7 @@ int seccomp_export_template_builtin(WORD_LIST *list, const char *fname)
 }
 int seccomp_export_bpf_builtin(WORD_LIST *list)
 {
-    return seccomp_export_template_builtin(list, "seccomp_export_bpf");
+    return seccomp_export_template_builtin(list, "seccomp_export_bpf", seccomp_export_bpf_index);
 }
 PUBLIC struct builtin seccomp_export_bpf_struct = {
     "seccomp_export_bpf",       /* builtin name */
@@ -1846,7 +3347,7 @@ PUBLIC struct builtin seccomp_export_bpf_struct = {
 
 int seccomp_export_pfc_builtin(WORD_LIST *list)
 {
-    return seccomp_export_template_builtin(list, "seccomp_export_pfc");
+    return seccomp_export_template_builtin(list, "seccomp_export_pfc", seccomp_export_pfc_index);
 }
 PUBLIC struct builtin seccomp_export_pfc_struct = {
     "seccomp_export_pfc",       /* builtin name */
@@ -1861,9 +3362,331 @@ PUBLIC struct builtin seccomp_export_pfc_struct = {
     0                             /* reserved for internal use */
 };
 
+/**
+ * 64-bit FNV-1a hash, used as the key of compiled filters in the seccomp cache.
+ */
+uint64_t fnv1a64(const unsigned char *data, size_t len)
+{
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+    for (size_t i = 0; i != len; ++i) {
+        hash ^= data[i];
+        hash *= UINT64_C(0x100000001b3);
+    }
+    return hash;
+}
+
+#define SECCOMP_CACHE_KEY_LEN 16
+#define SECCOMP_CACHE_SUFFIX ".bpf"
+
+/**
+ * @return NULL if neither -d nor $SECCOMP_CACHE_DIR is specified.
+ */
+const char* get_seccomp_cache_dir(const char *dir, const char *fname)
+{
+    if (dir == NULL)
+        dir = get_string_value("SECCOMP_CACHE_DIR");
+    if (dir == NULL || dir[0] == '\0') {
+        warnx("%s: %s", fname, "cache dir isn't specified by -d or $SECCOMP_CACHE_DIR");
+        return NULL;
+    }
+    return dir;
+}
+/**
+ * @param bpf compiled filter of len bytes.
+ */
+int seccomp_cache_write(const char *dir, const char *key, const char *bpf, size_t len, const char *fname)
+{
+    size_t dir_len = strlen(dir);
+
+    char path[dir_len + 1 + SECCOMP_CACHE_KEY_LEN + sizeof(SECCOMP_CACHE_SUFFIX)];
+    snprintf(path, sizeof(path), "%s/%s" SECCOMP_CACHE_SUFFIX, dir, key);
+
+    // An existing entry is replaced instead of being trusted, as it might be truncated or modified.
+    char tmp_path[sizeof(path) + sizeof(".XXXXXX")];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+    if (fd == -1) {
+        warn("%s: mkstemp %s failed", fname, tmp_path);
+        return (EXECUTION_FAILURE);
+    }
+
+    int ret = (EXECUTION_SUCCESS);
+    if (write_all(fd, bpf, len, fname) == -1 || fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH) == -1)
+        ret = (EXECUTION_FAILURE);
+    if (close(fd) == -1 && errno != EINTR)
+        ret = (EXECUTION_FAILURE);
+
+    if (ret == (EXECUTION_SUCCESS) && rename(tmp_path, path) == -1) {
+        warn("%s: rename %s to %s failed", fname, tmp_path, path);
+        ret = (EXECUTION_FAILURE);
+    }
+
+    if (ret != (EXECUTION_SUCCESS))
+        unlink(tmp_path);
+
+    return ret;
+}
+/**
+ * Entries are loaded into kernel and the hash is not collision-resistant, so only trust
+ * dir and files owned by euid that cannot be modified by others.
+ *
+ * @return 0 if trusted, -1 otherwise.
+ */
+int seccomp_cache_check_owner(int fd, const char *path, const char *fname)
+{
+    struct stat statbuf;
+    if (fstat(fd, &statbuf) == -1) {
+        warn("%s: fstat %s failed", fname, path);
+        return -1;
+    }
+    if (statbuf.st_uid != geteuid() || (statbuf.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+        warnx("%s: %s is not owned by euid or is writable by group/others", fname, path);
+        return -1;
+    }
+    return 0;
+}
+int seccomp_cache_store_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_cache_store";
+
+    typedef int (*seccomp_export_bpf_t)(const scmp_filter_ctx, int fd);
+
+    const char *dir = NULL;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "d:")) != -1; ) {
+        switch (opt) {
+        case 'd':
+            dir = list_optarg;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    const char *varname;
+    if (to_argv(list, 1, &varname) == -1)
+        return (EX_USAGE);
+
+    if ((dir = get_seccomp_cache_dir(dir, self_name)) == NULL)
+        return (EX_USAGE);
+
+    CHECK_SECCOMP_CTX_NOT_NULL();
+
+    seccomp_export_bpf_t seccomp_export_bpf_p = load_libseccomp_sym(seccomp_export_bpf);
+
+    int fd = memfd_create(self_name, MFD_CLOEXEC);
+    if (fd == -1) {
+        warn("%s: memfd_create failed", self_name);
+        return (EXECUTION_FAILURE);
+    }
+
+    int ret = (EXECUTION_SUCCESS);
+
+    int result = seccomp_export_bpf_p(seccomp_ctx, fd);
+    if (result != 0) {
+        errno = -result;
+        warn("%s: %s failed", self_name, "seccomp_export_bpf");
+        ret = (EXECUTION_FAILURE);
+        goto close_fd;
+    }
+
+    if (lseek(fd, 0, SEEK_SET) == (off_t) -1) {
+        warn("%s: lseek failed", self_name);
+        ret = (EXECUTION_FAILURE);
+        goto close_fd;
+    }
+
+    size_t len;
+    char *bpf = read_whole_file(fd, &len, self_name);
+    if (bpf == NULL) {
+        ret = (EXECUTION_FAILURE);
+        goto close_fd;
+    }
+
+    char key[SECCOMP_CACHE_KEY_LEN + 1];
+    snprintf(key, sizeof(key), "%016" PRIx64, fnv1a64((const unsigned char*) bpf, len));
+
+    ret = seccomp_cache_write(dir, key, bpf, len, self_name);
+    if (ret == (EXECUTION_SUCCESS))
+        bind_variable(varname, key, 0);
+
+    (free)(bpf);
+
+close_fd:
+    close(fd);
+
+    return ret;
+}
+PUBLIC struct builtin seccomp_cache_store_struct = {
+    "seccomp_cache_store",       /* builtin name */
+    seccomp_cache_store_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_cache_store compiles the current seccomp filter into BPF and stores it in the cache dir",
+        "(specified by -d or $SECCOMP_CACHE_DIR), under the hash of the compiled filter.",
+        "",
+        "The hash is stored in $var and can be passed to seccomp_cache_load.",
+        "",
+        "An existing entry under the same hash is atomically replaced by the new one.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_cache_store [-d dir] var",
+    0                             /* reserved for internal use */
+};
+
+int seccomp_cache_load_builtin(WORD_LIST *list)
+{
+    const char *self_name = "seccomp_cache_load";
+
+    const char *dir = NULL;
+    unsigned flags = 0;
+    int no_new_privs = 1;
+
+    reset_internal_getopt();
+    for (int opt; (opt = internal_getopt(list, "d:TLn")) != -1; ) {
+        switch (opt) {
+        case 'd':
+            dir = list_optarg;
+            break;
+
+        case 'T':
+            flags |= SECCOMP_FILTER_FLAG_TSYNC;
+            break;
+
+        case 'L':
+            flags |= SECCOMP_FILTER_FLAG_LOG;
+            break;
+
+        case 'n':
+            no_new_privs = 0;
+            break;
+
+        CASE_HELPOPT;
+
+        default:
+            builtin_usage();
+            return (EX_USAGE);
+        }
+    }
+    list = loptend;
+
+    const char *key;
+    if (to_argv(list, 1, &key) == -1)
+        return (EX_USAGE);
+
+    if (strlen(key) != SECCOMP_CACHE_KEY_LEN || key[strspn(key, "0123456789abcdef")] != '\0') {
+        warnx("%s: Invalid key %s", self_name, key);
+        return (EX_USAGE);
+    }
+
+    if ((dir = get_seccomp_cache_dir(dir, self_name)) == NULL)
+        return (EX_USAGE);
+
+    char path[strlen(dir) + 1 + SECCOMP_CACHE_KEY_LEN + sizeof(SECCOMP_CACHE_SUFFIX)];
+    snprintf(path, sizeof(path), "%s/%s" SECCOMP_CACHE_SUFFIX, dir, key);
+
+    int dirfd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd == -1) {
+        warn("%s: open %s failed", self_name, dir);
+        return 3;
+    }
+    if (seccomp_cache_check_owner(dirfd, dir, self_name) == -1) {
+        close(dirfd);
+        return (EXECUTION_FAILURE);
+    }
+
+    int fd;
+    do {
+        fd = openat(dirfd, path + strlen(dir) + 1, O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    } while (fd == -1 && errno == EINTR);
+    close(dirfd);
+    if (fd == -1) {
+        warn("%s: open %s failed", self_name, path);
+        return errno == ENOENT ? 3 : (EXECUTION_FAILURE);
+    }
+    if (seccomp_cache_check_owner(fd, path, self_name) == -1) {
+        close(fd);
+        return (EXECUTION_FAILURE);
+    }
+
+    size_t len;
+    char *bpf = read_whole_file(fd, &len, self_name);
+    close(fd);
+    if (bpf == NULL)
+        return (EXECUTION_FAILURE);
+
+    int ret = (EXECUTION_SUCCESS);
+
+    // The hash only catches entries that do not belong to key, e.g. a truncated write.
+    // It cannot detect a crafted filter, which is left to seccomp_cache_check_owner.
+    char hash[SECCOMP_CACHE_KEY_LEN + 1];
+    snprintf(hash, sizeof(hash), "%016" PRIx64, fnv1a64((const unsigned char*) bpf, len));
+
+    if (strcmp(hash, key) != 0 || len == 0 || len % sizeof(struct sock_filter) != 0 || 
+        len / sizeof(struct sock_filter) > BPF_MAXINSNS) {
+        warnx("%s: %s does not match key or is not a valid filter", self_name, path);
+        ret = (EXECUTION_FAILURE);
+        goto freeup;
+    }
+
+    struct sock_fprog prog = {
+        .len = len / sizeof(struct sock_filter),
+        .filter = (struct sock_filter*) bpf
+    };
+
+    if (no_new_privs && prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1) {
+        warn("%s: prctl PR_SET_NO_NEW_PRIVS failed", self_name);
+        ret = (EXECUTION_FAILURE);
+        goto freeup;
+    }
+
+    long result = syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, flags, &prog);
+    if (result == -1 && errno == ENOSYS && flags == 0)
+        result = prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog, 0, 0);
+
+    if (result != 0) {
+        warn("%s: seccomp(SECCOMP_SET_MODE_FILTER) failed", self_name);
+        ret = (EXECUTION_FAILURE);
+    }
+
+freeup:
+    (free)(bpf);
+
+    return ret;
+}
+PUBLIC struct builtin seccomp_cache_load_struct = {
+    "seccomp_cache_load",       /* builtin name */
+    seccomp_cache_load_builtin, /* function implementing the builtin */
+    BUILTIN_ENABLED,               /* initial flags for builtin */
+    (char*[]){
+        "seccomp_cache_load loads the filter stored by seccomp_cache_store under key into kernel directly,",
+        "without loading libseccomp.so or requiring seccomp_init.",
+        "",
+        "Cache dir is specified by -d or $SECCOMP_CACHE_DIR.",
+        "",
+        "NO_NEW_PRIVS is set before loading the filter unless '-n' is passed.",
+        "If '-T' is passed, the filter is synchronized across all threads (same as CTL_TSYNC).",
+        "If '-L' is passed, all not allowed syscalls are logged (same as CTL_LOG).",
+        "",
+        "The cache dir and the entry must be owned by euid and must not be writable by group or others,",
+        "since the hash of the entry only guards against accidental mismatch, not tampering.",
+        "",
+        "Returns 3 if the filter isn't found in the cache.",
+        (char*) NULL
+    },                            /* array of long documentation strings. */
+    "seccomp_cache_load [-d dir] [-TLn] key",
+    0                             /* reserved for internal use */
+};
+
 int seccomp_api_get_builtin(WORD_LIST *list)
 {
-    const char *self_name = "seccomp_api_get";
     typedef const unsigned int (*seccomp_api_get_t)();
 
     if (check_no_options(&list) == -1)
@@ -1874,7 +3697,7 @@ int seccomp_api_get_builtin(WORD_LIST *list)
         return (EX_USAGE);
     }
 
-    seccomp_api_get_t seccomp_api_get_p = load_libseccomp_sym(self_name);
+    seccomp_api_get_t seccomp_api_get_p = load_libseccomp_sym(seccomp_api_get);
     return seccomp_api_get_p() + 3;
 }
 PUBLIC struct builtin seccomp_api_get_struct = {
@@ -1908,7 +3731,7 @@ int seccomp_version_builtin(WORD_LIST *list)
         return (EX_USAGE);
     }
 
-    seccomp_version_t seccomp_version_p = load_libseccomp_sym(self_name);
+    seccomp_version_t seccomp_version_p = load_libseccomp_sym(seccomp_version);
     const struct scmp_version *version = seccomp_version_p();
 
     int result = printf("%u.%u.%u\n", version->major, version->minor, version->micro);
@@ -1979,11 +3802,23 @@ int sandboxing_builtin(WORD_LIST *_)
         { .word = "seccomp_arch_exist", .flags = 0 },
         { .word = "seccomp_attr_set", .flags = 0 },
         { .word = "seccomp_syscall_priority", .flags = 0 },
+        { .word = "seccomp_profile_start", .flags = 0 },
+        { .word = "seccomp_profile_apply", .flags = 0 },
         { .word = "seccomp_load", .flags = 0 },
+        { .word = "seccomp_load_policy", .flags = 0 },
+        { .word = "seccomp_notify_fd", .flags = 0 },
+        { .word = "seccomp_notify_recv", .flags = 0 },
+        { .word = "seccomp_notify_respond", .flags = 0 },
+        { .word = "seccomp_notify_addfd", .flags = 0 },
+        { .word = "seccomp_notify_id_valid", .flags = 0 },
         { .word = "seccomp_export_bpf", .flags = 0 },
         { .word = "seccomp_export_pfc", .flags = 0 },
+        { .word = "seccomp_cache_store", .flags = 0 },
+        { .word = "seccomp_cache_load", .flags = 0 },
         { .word = "seccomp_api_get", .flags = 0 },
         { .word = "seccomp_version", .flags = 0 },
+
+        { .word = "sandboxing_preload", .flags = 0 },
     };
 
     const size_t builtin_num = sizeof(words) / sizeof(WORD_DESC);
@@ -0,0 +1,308 @@
+#ifndef  __bash_loadables_thread_pool_H_
+# define __bash_loadables_thread_pool_H_
+
+/**
+ * Fixed-size pool of worker threads used by builtins that do a lot of independent syscalls.
+ *
+ * Jobs must not call into bash: only the thread that runs the builtin may do so.
+ * This includes malloc, realloc and free, since bash is built with its own allocator by
+ * default, which has no locking. Libc functions that allocate (e.g. opendir and qsort)
+ * must be avoided as well. Instead:
+ *  - job records are allocated by the thread that runs the builtin and handed back to it
+ *    by thread_pool_reap once finished, so that it can free them;
+ *  - memory needed by jobs comes from the arenas of the worker running them, which only
+ *    rely on mmap.
+ *
+ * Workers block all signals, so that signals are still delivered to bash.
+ */
+
+#include "utilities.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+/**
+ * State of a thread running jobs, which is only accessed by that thread until
+ * thread_pool_destroy.
+ */
+struct thread_pool_worker {
+    struct thread_pool *pool;
+    /**
+     * Memory that lives until thread_pool_destroy, e.g. results and jobs submitted by jobs.
+     */
+    struct arena arena;
+    /**
+     * Memory for buffers, which must be rewound with arena_mark/arena_release by the job.
+     * Its first chunk is kept, so that buffers are not mmaped again for every job.
+     */
+    struct arena scratch;
+};
+
+struct thread_pool_job {
+    struct thread_pool_job *next;
+    /**
+     * @return non-zero on failure.
+     *
+     * job must not be freed by func: it is handed back by thread_pool_reap instead.
+     */
+    int (*func)(struct thread_pool_job *job, struct thread_pool_worker *worker);
+};
+
+struct thread_pool {
+    pthread_mutex_t mutex;
+    pthread_cond_t has_job;  // signaled when a job is queued or the pool is shutting down
+    pthread_cond_t has_room; // signaled when a job is taken or finished
+    struct thread_pool_job *head;
+    struct thread_pool_job **tail;
+    struct thread_pool_job *finished;
+    size_t nqueued;
+    size_t max_queued;
+    size_t nrunning;
+    size_t nfailed;
+    int shutdown;
+    size_t nthreads;
+    pthread_t *threads;
+    size_t nstarted;
+    /**
+     * One per thread, or a single one used by thread_pool_submit if there is no thread.
+     */
+    struct thread_pool_worker *workers;
+};
+
+void* thread_pool_worker(void *arg)
+{
+    struct thread_pool *pool = arg;
+
+    pthread_mutex_lock(&pool->mutex);
+    struct thread_pool_worker *worker = &pool->workers[pool->nstarted++];
+    for (;;) {
+        while (pool->head == NULL && !pool->shutdown)
+            pthread_cond_wait(&pool->has_job, &pool->mutex);
+        if (pool->head == NULL)
+            break;
+
+        struct thread_pool_job *job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL)
+            pool->tail = &pool->head;
+        --pool->nqueued;
+        ++pool->nrunning;
+        pthread_cond_broadcast(&pool->has_room);
+        pthread_mutex_unlock(&pool->mutex);
+
+        int failed = job->func(job, worker);
+
+        pthread_mutex_lock(&pool->mutex);
+        job->next = pool->finished;
+        pool->finished = job;
+        --pool->nrunning;
+        pool->nfailed += failed != 0;
+        if (pool->nrunning == 0 && pool->nqueued == 0)
+            pthread_cond_broadcast(&pool->has_room);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+/**
+ * @param nthreads if it is 0 or no thread can be created, jobs are run in thread_pool_submit.
+ * @param max_queued thread_pool_submit blocks once there are max_queued jobs waiting.
+ *                   Use SIZE_MAX if jobs submit other jobs to avoid deadlock.
+ * @return -1 on failure with err msg printed, 0 otherwise.
+ */
+int thread_pool_init(struct thread_pool *pool, size_t nthreads, size_t max_queued)
+{
+    size_t nworkers = nthreads == 0 ? 1 : nthreads;
+    pool->workers = malloc(nworkers * sizeof(struct thread_pool_worker));
+    if (pool->workers == NULL) {
+        warn("malloc failed");
+        return -1;
+    }
+    for (size_t i = 0; i != nworkers; ++i) {
+        pool->workers[i] = (struct thread_pool_worker){
+            .pool = pool,
+            .arena = { NULL, 0 },
+            .scratch = { NULL, SIZE_MAX },
+        };
+    }
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->has_job, NULL);
+    pthread_cond_init(&pool->has_room, NULL);
+
+    pool->head = NULL;
+    pool->tail = &pool->head;
+    pool->finished = NULL;
+    pool->nqueued = 0;
+    pool->max_queued = max_queued;
+    pool->nrunning = 0;
+    pool->nfailed = 0;
+    pool->shutdown = 0;
+    pool->nthreads = 0;
+    pool->threads = NULL;
+    pool->nstarted = 0;
+
+    if (nthreads == 0)
+        return 0;
+
+    pool->threads = malloc(nthreads * sizeof(pthread_t));
+    if (pool->threads == NULL)
+        return 0;
+
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    for (; pool->nthreads != nthreads; ++pool->nthreads) {
+        if (pthread_create(&pool->threads[pool->nthreads], NULL, thread_pool_worker, pool) != 0)
+            break;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    return 0;
+}
+
+/**
+ * Must be called by the thread running the builtin, or by a job with the worker running it.
+ *
+ * @param worker worker running the caller, or NULL if the caller is the thread running
+ *               the builtin.
+ */
+void thread_pool_submit(struct thread_pool *pool, struct thread_pool_worker *worker,
+                        struct thread_pool_job *job)
+{
+    if (pool->nthreads == 0) {
+        pool->nfailed += job->func(job, worker != NULL ? worker : &pool->workers[0]) != 0;
+        job->next = pool->finished;
+        pool->finished = job;
+        return;
+    }
+
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->nqueued >= pool->max_queued)
+        pthread_cond_wait(&pool->has_room, &pool->mutex);
+
+    *pool->tail = job;
+    pool->tail = &job->next;
+    ++pool->nqueued;
+    pthread_cond_signal(&pool->has_job);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+/**
+ * @return jobs finished since last call linked by next, which are owned by the caller
+ *         from now on.
+ */
+struct thread_pool_job* thread_pool_reap(struct thread_pool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    struct thread_pool_job *finished = pool->finished;
+    pool->finished = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return finished;
+}
+/**
+ * Frees jobs finished since last call, for pools whose jobs are all allocated by malloc.
+ */
+void thread_pool_free_finished(struct thread_pool *pool)
+{
+    for (struct thread_pool_job *job = thread_pool_reap(pool), *next; job != NULL; job = next) {
+        next = job->next;
+        (free)(job);
+    }
+}
+
+/**
+ * Waits for all submitted jobs to finish.
+ *
+ * @return number of jobs failed since last call.
+ */
+size_t thread_pool_wait(struct thread_pool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->nqueued != 0 || pool->nrunning != 0)
+        pthread_cond_wait(&pool->has_room, &pool->mutex);
+
+    size_t nfailed = pool->nfailed;
+    pool->nfailed = 0;
+    pthread_mutex_unlock(&pool->mutex);
+
+    return nfailed;
+}
+
+/**
+ * Waits for all submitted jobs to finish, joins all threads and frees the arenas of workers.
+ *
+ * Finished jobs that are not reaped yet are left to the caller.
+ */
+void thread_pool_destroy(struct thread_pool *pool)
+{
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->has_job);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (size_t i = 0; i != pool->nthreads; ++i)
+        pthread_join(pool->threads[i], NULL);
+    (free)(pool->threads);
+
+    size_t nworkers = pool->nthreads == 0 ? 1 : pool->nthreads;
+    for (size_t i = 0; i != nworkers; ++i) {
+        arena_free_all(&pool->workers[i].arena);
+        arena_free_all(&pool->workers[i].scratch);
+    }
+    (free)(pool->workers);
+
+    pthread_cond_destroy(&pool->has_room);
+    pthread_cond_destroy(&pool->has_job);
+    pthread_mutex_destroy(&pool->mutex);
+}
+
+#define THREAD_POOL_MAX_THREADS 1024
+
+/**
+ * Parse the argument of '-j' of builtins, which is at most THREAD_POOL_MAX_THREADS.
+ *
+ * @return -1 on error with usage printed, 0 otherwise.
+ */
+int parse_nthreads(const char *arg, size_t *nthreads, const char *fname)
+{
+    unsigned n;
+    switch (str2uint(arg, &n)) {
+        case -1:
+            builtin_usage();
+            return -1;
+
+        case 0:
+            if (n <= THREAD_POOL_MAX_THREADS) {
+                *nthreads = n;
+                return 0;
+            }
+
+        case -2:
+            warnx("%s: Invalid number of threads %s, expected 0 to %d", fname, arg, 
+                  THREAD_POOL_MAX_THREADS);
+            builtin_usage();
+            return -1;
+    }
+
+    return -1;
+}
+/**
+ * @return number of threads to use by default, which is the number of online cpus.
+ */
+size_t thread_pool_default_nthreads(void)
+{
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpus > 0 ? ncpus : 1;
+}
+
+#endif
@@ -0,0 +1,390 @@
+/* gen_lookup - generates perfect hash tables in lookup_tables.h from lookup_tables.def */
+
+/**
+ * Usage: gen_lookup lookup_tables.def lookup_tables.h
+ *
+ * Format of lookup_tables.def, where '#' starts a comment:
+ *
+ *     group name
+ *     table name value_type
+ *     key value [condition]
+ *
+ * Tables after 'group name' are only defined if LOOKUP_TABLES_NAME is defined before
+ * including lookup_tables.h, except for group common, which is always defined.
+ *
+ * Every table 'table name value_type' defines struct lookup_table lookup_name and
+ * value_type lookup_name_values[], check utilities.h for how to use them.
+ *
+ * value and condition are C expressions, value must not contain whitespaces.
+ * If condition is present, the key is only added if condition holds when included.
+ *
+ * Keys are case-insensitive.
+ */
+
+#define _DEFAULT_SOURCE
+
+#include "../lookup.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include <err.h>
+
+#define MAX_DISP UINT16_MAX
+
+struct entry {
+    char *key;
+    char *value;
+    /**
+     * NULL if there is no condition.
+     */
+    char *cond;
+
+    uint32_t hash;
+    uint16_t offset;
+};
+
+struct table {
+    char *name;
+    char *type;
+    const char *group;
+
+    struct entry *entries;
+    size_t nentries;
+
+    uint32_t nslots;
+    uint32_t ndisps;
+    uint16_t *disps;
+    /**
+     * slots[i] is the index into entries, or -1 if empty.
+     */
+    ssize_t *slots;
+};
+
+static struct table *tables;
+static size_t ntables;
+
+void* xrealloc(void *ptr, size_t size)
+{
+    ptr = realloc(ptr, size);
+    if (ptr == NULL)
+        err(1, "realloc %zu failed", size);
+    return ptr;
+}
+char* xstrdup(const char *str)
+{
+    char *ret = strdup(str);
+    if (ret == NULL)
+        err(1, "strdup failed");
+    return ret;
+}
+
+/**
+ * @return next whitespace-separated token in *line, NULL if there is none.
+ */
+char* next_token(char **line)
+{
+    char *token = *line + strspn(*line, " \t");
+    if (token[0] == '\0')
+        return NULL;
+
+    char *end = token + strcspn(token, " \t");
+    if (end[0] != '\0')
+        *end++ = '\0';
+    *line = end;
+
+    return token;
+}
+/**
+ * @return rest of line with whitespaces at both ends stripped, NULL if it is empty.
+ */
+char* rest_of_line(char *line)
+{
+    line += strspn(line, " \t");
+
+    size_t len = strlen(line);
+    while (len != 0 && isspace((unsigned char) line[len - 1]))
+        line[--len] = '\0';
+
+    return len == 0 ? NULL : line;
+}
+
+void parse_spec(FILE *spec, const char *path)
+{
+    const char *group = "common";
+
+    char *line = NULL;
+    size_t cap = 0;
+    for (size_t lineno = 1; getline(&line, &cap, spec) != -1; ++lineno) {
+        line[strcspn(line, "#\n")] = '\0';
+
+        char *rest = line;
+        char *token = next_token(&rest);
+        if (token == NULL)
+            continue;
+
+        if (strcmp(token, "group") == 0) {
+            group = rest_of_line(rest);
+            if (group == NULL)
+                errx(1, "%s:%zu: group without name", path, lineno);
+            for (size_t i = 0; i != ntables; ++i) {
+                if (strcmp(tables[i].group, group) == 0)
+                    errx(1, "%s:%zu: group %s is specified twice", path, lineno, group);
+            }
+            group = xstrdup(group);
+        } else if (strcmp(token, "table") == 0) {
+            char *name = next_token(&rest);
+            char *type = rest_of_line(rest);
+            if (name == NULL || type == NULL)
+                errx(1, "%s:%zu: table requires name and value_type", path, lineno);
+
+            tables = xrealloc(tables, (ntables + 1) * sizeof(struct table));
+            tables[ntables++] = (struct table){
+                .name = xstrdup(name),
+                .type = xstrdup(type),
+                .group = group,
+            };
+        } else {
+            if (ntables == 0)
+                errx(1, "%s:%zu: key before any table", path, lineno);
+
+            char *value = next_token(&rest);
+            if (value == NULL)
+                errx(1, "%s:%zu: key %s without value", path, lineno, token);
+            char *cond = rest_of_line(rest);
+
+            struct table *table = &tables[ntables - 1];
+            for (size_t i = 0; i != table->nentries; ++i) {
+                if (strcasecmp(table->entries[i].key, token) == 0)
+                    errx(1, "%s:%zu: duplicate key %s", path, lineno, token);
+            }
+
+            table->entries = xrealloc(table->entries, (table->nentries + 1) * sizeof(struct entry));
+            table->entries[table->nentries++] = (struct entry){
+                .key = xstrdup(token),
+                .value = xstrdup(value),
+                .cond = cond == NULL ? NULL : xstrdup(cond),
+                .hash = lookup_hash(token, strlen(token)),
+            };
+        }
+    }
+    free(line);
+
+    if (ferror(spec))
+        err(1, "reading %s failed", path);
+}
+
+/**
+ * @return 0 on success, -1 if no displacement works for some bucket.
+ */
+int try_build(struct table *table, uint32_t nslots, uint32_t ndisps)
+{
+    table->nslots = nslots;
+    table->ndisps = ndisps;
+    table->disps = xrealloc(table->disps, ndisps * sizeof(uint16_t));
+    table->slots = xrealloc(table->slots, nslots * sizeof(ssize_t));
+
+    for (uint32_t i = 0; i != nslots; ++i)
+        table->slots[i] = -1;
+
+    // Bucket the entries by displacement and place the largest buckets first.
+    size_t *bucket_sizes = calloc(ndisps, sizeof(size_t));
+    size_t *order = malloc(ndisps * sizeof(size_t));
+    if (bucket_sizes == NULL || order == NULL)
+        err(1, "malloc failed");
+
+    for (size_t i = 0; i != table->nentries; ++i)
+        ++bucket_sizes[lookup_reduce(table->entries[i].hash, ndisps)];
+    for (size_t i = 0; i != ndisps; ++i)
+        order[i] = i;
+    for (size_t i = 1; i < ndisps; ++i) {
+        for (size_t j = i; j != 0 && bucket_sizes[order[j - 1]] < bucket_sizes[order[j]]; --j) {
+            size_t tmp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = tmp;
+        }
+    }
+
+    int ret = 0;
+    for (size_t i = 0; i != ndisps && ret == 0; ++i) {
+        uint32_t bucket = order[i];
+        table->disps[bucket] = 0;
+        if (bucket_sizes[bucket] == 0)
+            continue;
+
+        ret = -1;
+        for (uint32_t disp = 0; disp <= MAX_DISP; ++disp) {
+            size_t placed = 0;
+            for (size_t j = 0; j != table->nentries; ++j) {
+                struct entry *entry = &table->entries[j];
+                if (lookup_reduce(entry->hash, ndisps) != bucket)
+                    continue;
+
+                uint32_t slot = lookup_slot(entry->hash, disp, nslots);
+                if (table->slots[slot] != -1)
+                    break;
+                table->slots[slot] = j;
+                ++placed;
+            }
+
+            if (placed == bucket_sizes[bucket]) {
+                table->disps[bucket] = disp;
+                ret = 0;
+                break;
+            }
+
+            // Undo the partial placement
+            for (uint32_t slot = 0; slot != nslots; ++slot) {
+                ssize_t j = table->slots[slot];
+                if (j != -1 && lookup_reduce(table->entries[j].hash, ndisps) == bucket)
+                    table->slots[slot] = -1;
+            }
+        }
+    }
+
+    free(order);
+    free(bucket_sizes);
+
+    return ret;
+}
+void build(struct table *table)
+{
+    size_t n = table->nentries;
+    if (n == 0)
+        errx(1, "table %s is empty", table->name);
+
+    for (size_t i = 0; i != n; ++i) {
+        for (size_t j = i + 1; j != n; ++j) {
+            if (table->entries[i].hash == table->entries[j].hash)
+                errx(1, "table %s: %s and %s have the same hash", table->name,
+                     table->entries[i].key, table->entries[j].key);
+        }
+    }
+
+    // Start with load factor 0.9 and add slots until it succeeds.
+    uint32_t ndisps = n / 3 + 1;
+    for (uint32_t nslots = n + n / 9; ; ++nslots) {
+        if (try_build(table, nslots, ndisps) == 0)
+            return;
+        if (nslots > 4 * n)
+            errx(1, "failed to build perfect hash table for %s", table->name);
+    }
+}
+
+void emit_table(FILE *out, struct table *table)
+{
+    fprintf(out, "\n/* table %s */\n", table->name);
+
+    // Offset 0 is the empty name used by empty slots.
+    size_t offset = 1;
+    fprintf(out, "static const char lookup_%s_names[] __attribute__((unused)) =\n    \"\\0\"", table->name);
+    for (size_t i = 0; i != table->nentries; ++i) {
+        struct entry *entry = &table->entries[i];
+        entry->offset = offset;
+        fprintf(out, "\n    \"%s\\0\"", entry->key);
+
+        offset += strlen(entry->key) + 1;
+        if (offset > UINT16_MAX)
+            errx(1, "names of table %s are too long", table->name);
+    }
+    fputs(";\n", out);
+
+    fprintf(out, "static const uint16_t lookup_%s_offsets[] __attribute__((unused)) = {\n", table->name);
+    for (uint32_t slot = 0; slot != table->nslots; ++slot) {
+        ssize_t j = table->slots[slot];
+        if (j == -1)
+            fputs("    0,\n", out);
+        else if (table->entries[j].cond == NULL)
+            fprintf(out, "    %u, /* %s */\n", table->entries[j].offset, table->entries[j].key);
+        else
+            fprintf(out, "#if %s\n    %u, /* %s */\n#else\n    0,\n#endif\n", table->entries[j].cond,
+                    table->entries[j].offset, table->entries[j].key);
+    }
+    fputs("};\n", out);
+
+    fprintf(out, "static const %s lookup_%s_values[] __attribute__((unused)) = {\n", table->type, table->name);
+    for (uint32_t slot = 0; slot != table->nslots; ++slot) {
+        ssize_t j = table->slots[slot];
+        if (j == -1)
+            fputs("    0,\n", out);
+        else if (table->entries[j].cond == NULL)
+            fprintf(out, "    %s,\n", table->entries[j].value);
+        else
+            fprintf(out, "#if %s\n    %s,\n#else\n    0,\n#endif\n", table->entries[j].cond,
+                    table->entries[j].value);
+    }
+    fputs("};\n", out);
+
+    fprintf(out, "static const uint16_t lookup_%s_disps[] __attribute__((unused)) = {", table->name);
+    for (uint32_t i = 0; i != table->ndisps; ++i)
+        fprintf(out, "%s%u,", i % 16 == 0 ? "\n    " : " ", table->disps[i]);
+    fputs("\n};\n", out);
+
+    fprintf(out,
+            "static const struct lookup_table lookup_%s __attribute__((unused)) = {\n"
+            "    lookup_%s_names, lookup_%s_offsets, lookup_%s_disps, %u, %u\n"
+            "};\n",
+            table->name, table->name, table->name, table->name, table->nslots, table->ndisps);
+}
+void emit(FILE *out, const char *spec_path)
+{
+    fprintf(out, "/* Generated by tools/gen_lookup from %s, DO NOT EDIT. */\n", spec_path);
+    fputs("\n#include \"lookup.h\"\n", out);
+
+    for (size_t i = 0; i != ntables; ++i) {
+        const char *group = tables[i].group;
+        if (i != 0 && strcmp(group, tables[i - 1].group) == 0)
+            continue;
+
+        char upper[strlen(group) + 1];
+        for (size_t j = 0; j != sizeof(upper); ++j)
+            upper[j] = toupper((unsigned char) group[j]);
+
+        if (strcmp(group, "common") == 0)
+            fprintf(out, "\n#ifndef LOOKUP_TABLES_%s_H_\n", upper);
+        else
+            fprintf(out, "\n#if defined(LOOKUP_TABLES_%s) && !defined(LOOKUP_TABLES_%s_H_)\n", upper, upper);
+        fprintf(out, "# define LOOKUP_TABLES_%s_H_\n", upper);
+
+        for (size_t j = i; j != ntables && strcmp(tables[j].group, group) == 0; ++j)
+            emit_table(out, &tables[j]);
+
+        fputs("\n#endif\n", out);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+        errx(1, "Usage: %s lookup_tables.def lookup_tables.h", argv[0]);
+
+    FILE *spec = fopen(argv[1], "r");
+    if (spec == NULL)
+        err(1, "open %s failed", argv[1]);
+    parse_spec(spec, argv[1]);
+    fclose(spec);
+
+    for (size_t i = 0; i != ntables; ++i)
+        build(&tables[i]);
+
+    // Write to a tmp file first so that make does not see a half-written header.
+    size_t len = strlen(argv[2]);
+    char tmp_path[len + sizeof(".tmp")];
+    memcpy(tmp_path, argv[2], len);
+    memcpy(tmp_path + len, ".tmp", sizeof(".tmp"));
+
+    FILE *out = fopen(tmp_path, "w");
+    if (out == NULL)
+        err(1, "open %s failed", tmp_path);
+    emit(out, argv[1]);
+    if (fclose(out) != 0)
+        err(1, "writing %s failed", tmp_path);
+
+    if (rename(tmp_path, argv[2]) == -1)
+        err(1, "rename %s to %s failed", tmp_path, argv[2]);
+
+    return 0;
+}
@@ -16,49 +16,158 @@
 
 #include <limits.h>
 
+#include <stddef.h>
+
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
-#include "errnos.h"
+#include <errno.h>
 #include <err.h>
 
+#include "lookup_tables.h"
+
 #define VLA_MAXLEN (50 * sizeof(void*))
 
 /**
- * START_VLA automatically switched between VLA and malloc.
+ * Bump allocator backing START_VLA and START_VLA2 once the buffer is too large for stack,
+ * so that scratch buffers of builtins never touch the malloc heap.
+ *
+ * Memory is mmaped in chunks of at least ARENA_CHUNK_SIZE. START_VLA records the top of
+ * the arena and END_VLA rewinds it, so the arena is empty again when the builtin returns.
+ * The first chunk is kept for later invocations unless it is larger than keep_size.
+ *
+ * Since it only relies on mmap, an arena can also be used by threads other than the one
+ * running bash, as long as each arena is used by one thread at a time.
+ */
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
+struct arena_chunk {
+    struct arena_chunk *prev;
+    /**
+     * Size of data
+     */
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+struct arena {
+    struct arena_chunk *top;
+    size_t keep_size;
+};
+static struct arena vla_arena = { NULL, ARENA_CHUNK_SIZE };
+
+struct arena_mark {
+    struct arena_chunk *chunk;
+    size_t used;
+};
+
+struct arena_mark arena_mark(const struct arena *arena)
+{
+    return (struct arena_mark){ arena->top, arena->top == NULL ? 0 : arena->top->used };
+}
+/**
+ * @return NULL on failure and print err msg to stderr.
+ */
+void* arena_alloc(struct arena *arena, size_t size)
+{
+    const size_t align = _Alignof(max_align_t);
+    size = (size + align - 1) & ~(align - 1);
+
+    if (arena->top == NULL || arena->top->size - arena->top->used < size) {
+        const size_t page_size = 4096;
+        size_t chunk_size = sizeof(struct arena_chunk) + size;
+        if (chunk_size < ARENA_CHUNK_SIZE)
+            chunk_size = ARENA_CHUNK_SIZE;
+        chunk_size = (chunk_size + page_size - 1) & ~(page_size - 1);
+
+        struct arena_chunk *chunk = mmap(NULL, chunk_size, PROT_READ | PROT_WRITE,
+                                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED) {
+            warn("mmap %zu failed", chunk_size);
+            return NULL;
+        }
+
+        chunk->prev = arena->top;
+        chunk->size = chunk_size - sizeof(struct arena_chunk);
+        chunk->used = 0;
+        arena->top = chunk;
+    }
+
+    void *ret = (char*) arena->top->data + arena->top->used;
+    arena->top->used += size;
+    return ret;
+}
+void arena_free_chunk(struct arena_chunk *chunk)
+{
+    if (munmap(chunk, sizeof(struct arena_chunk) + chunk->size) == -1)
+        warn("munmap failed");
+}
+/**
+ * Frees everything allocated after mark is taken.
+ */
+void arena_release(struct arena *arena, const struct arena_mark *mark)
+{
+    while (arena->top != mark->chunk) {
+        struct arena_chunk *prev = arena->top->prev;
+        if (prev == NULL && arena->top->size + sizeof(struct arena_chunk) <= arena->keep_size) {
+            arena->top->used = 0;
+            return;
+        }
+
+        arena_free_chunk(arena->top);
+        arena->top = prev;
+    }
+
+    if (arena->top != NULL)
+        arena->top->used = mark->used;
+}
+/**
+ * Frees all chunks, to be called when the loadable is unloaded.
+ */
+void arena_free_all(struct arena *arena)
+{
+    while (arena->top != NULL) {
+        struct arena_chunk *prev = arena->top->prev;
+        arena_free_chunk(arena->top);
+        arena->top = prev;
+    }
+}
+
+/**
+ * START_VLA automatically switched between VLA and the arena.
  *
  * It must be put in a single statement.
  *
  * There can only be one START_VLA and one END_VLA in one scope.
  */
-#define START_VLA(type, n, varname)                  \
-    type vla[n * sizeof(type) > VLA_MAXLEN ? 0 : n]; \
-    if (sizeof(vla) == 0) {                          \
-        varname = malloc(n * sizeof(type));          \
-        if (varname == NULL) {                       \
-            warnx("malloc %zu failed", n * sizeof(type)); \
-            return (EXECUTION_FAILURE);              \
-        }                                            \
-    } else                                           \
+#define START_VLA(type, n, varname)                                \
+    type vla[(n) * sizeof(type) > VLA_MAXLEN ? 0 : (n)];           \
+    struct arena_mark vla_mark = arena_mark(&vla_arena);           \
+    if (sizeof(vla) == 0) {                                        \
+        varname = arena_alloc(&vla_arena, (n) * sizeof(type));     \
+        if (varname == NULL)                                       \
+            return (EXECUTION_FAILURE);                            \
+    } else                                                         \
         varname = vla
 
 /**
  * START_VLA2 is almost the same as START_VLA except that it 
  * initializes the array to 0.
  */
-#define START_VLA2(type, n, varname)                 \
-    type vla[n * sizeof(type) > VLA_MAXLEN ? 0 : n]; \
-    do {                                             \
-        if (sizeof(vla) != 0) {                      \
-            varname = vla;                           \
-            memset(vla, 0, sizeof(vla));             \
-        } else {                                     \
-            varname = calloc(n, sizeof(type));       \
-            if (varname == NULL) {                   \
-                warnx("calloc %zu failed", n * sizeof(type)); \
-                return (EXECUTION_FAILURE);          \
-            }                                        \
-        }                                            \
+#define START_VLA2(type, n, varname)                               \
+    type vla[(n) * sizeof(type) > VLA_MAXLEN ? 0 : (n)];           \
+    struct arena_mark vla_mark = arena_mark(&vla_arena);           \
+    do {                                                           \
+        if (sizeof(vla) != 0)                                      \
+            varname = vla;                                         \
+        else {                                                     \
+            varname = arena_alloc(&vla_arena, (n) * sizeof(type)); \
+            if (varname == NULL)                                   \
+                return (EXECUTION_FAILURE);                        \
+        }                                                          \
+        memset(varname, 0, (n) * sizeof(type));                    \
     } while (0)
 
 /**
@@ -66,16 +175,114 @@
  */
 #define END_VLA(varname)  \
     if (sizeof(vla) == 0) \
-        (free)(varname)
+        arena_release(&vla_arena, &vla_mark)
 
 #define STR_IMPL_(x) #x      //stringify argument
 #define STR(x) STR_IMPL_(x)  //indirection to expand argument macros
 
+/**
+ * Formats val in decimal at the end of buffer.
+ *
+ * @param end points to the end of a buffer of at least sizeof(STR(UINTMAX_MAX)) bytes.
+ * @return start of the NUL-terminated result.
+ */
+char* uint2str(uintmax_t val, char *end)
+{
+    char *p = end;
+    *--p = '\0';
+    do {
+        *--p = '0' + val % 10;
+        val /= 10;
+    } while (val != 0);
+    return p;
+}
+/**
+ * Same as uint2str, except that val is signed.
+ */
+char* int2str(intmax_t val, char *end)
+{
+    if (val >= 0)
+        return uint2str(val, end);
+
+    // -(val + 1) + 1 avoids overflow on INTMAX_MIN
+    char *p = uint2str((uintmax_t) -(val + 1) + 1, end);
+    *--p = '-';
+    return p;
+}
+
+/**
+ * Appends value at index i to array, where i must be larger than the max index of array.
+ *
+ * Unlike array_insert, it never searches the array.
+ */
+void array_append(ARRAY *array, arrayind_t i, char *value)
+{
+#if defined(ALT_ARRAY_IMPLEMENTATION) || !defined(ADD_BEFORE)
+    array_insert(array, i, value);
+#else
+    ARRAY_ELEMENT *element = array_create_element(i, value);
+    ADD_BEFORE(array->head, element);
+    array->max_index = i;
+    ++array->num_elements;
+# ifdef SET_LASTREF
+    SET_LASTREF(array, element);
+# endif
+#endif
+}
+
+/**
+ * bind_*_array set varname to an indexed array of n elements in vals.
+ *
+ * @return the array.
+ */
+ARRAY* bind_str_array(const char *varname, char * const *vals, size_t n)
+{
+    ARRAY *array = array_cell(make_new_array_variable((char*) varname));
+    for (size_t i = 0; i != n; ++i)
+        array_append(array, i, vals[i]);
+    return array;
+}
+ARRAY* bind_int_array(const char *varname, const int *vals, size_t n)
+{
+    ARRAY *array = array_cell(make_new_array_variable((char*) varname));
+    char buffer[sizeof(STR(INTMAX_MIN))];
+    for (size_t i = 0; i != n; ++i)
+        array_append(array, i, int2str(vals[i], buffer + sizeof(buffer)));
+    return array;
+}
+ARRAY* bind_uint_array(const char *varname, const unsigned *vals, size_t n)
+{
+    ARRAY *array = array_cell(make_new_array_variable((char*) varname));
+    char buffer[sizeof(STR(UINTMAX_MAX))];
+    for (size_t i = 0; i != n; ++i)
+        array_append(array, i, uint2str(vals[i], buffer + sizeof(buffer)));
+    return array;
+}
+
 uintmax_t min_unsigned(uintmax_t x, uintmax_t y)
 {
     return x > y ? y : x;
 }
 
+/**
+ * @return 0 on success, -1 on failure.
+ */
+int write_all(int fd, const char *buffer, size_t len, const char *fname)
+{
+    while (len != 0) {
+        ssize_t result = write(fd, buffer, min_unsigned(len, SSIZE_MAX));
+        if (result == -1) {
+            if (errno == EINTR)
+                continue;
+            warn("%s: write failed", fname);
+            return -1;
+        }
+        buffer += result;
+        len -= result;
+    }
+    return 0;
+}
+
 /**
  * @param str must not be null
  * @param integer must be a valid pointer.
@@ -136,6 +343,33 @@ int str2uint32(const char *str, uint32_t *integer)
     return 0;
 }
 
+/**
+ * @param str must not be null
+ * @param integer must be a valid pointer.
+ *                If str2uint64 failed, its value is unchanged.
+ * @return 0 on success, -1 if not integer, -2 if too large.
+ *
+ * Unlike str2uint32, this function accepts value larger than INTMAX_MAX.
+ *
+ * NOTE that this function does not call builtin_usage on error.
+ */
+int str2uint64(const char *str, uint64_t *integer)
+{
+    if (str[0] < '0' || str[0] > '9')
+        return -1;
+
+    char *end;
+    errno = 0;
+    unsigned long long result = strtoull(str, &end, 10);
+    if (*end != '\0')
+        return -1;
+    else if (errno == ERANGE || result > UINT64_MAX)
+        return -2;
+
+    *integer = result;
+    return 0;
+}
+
 /**
  * @param str must not be null
  * @param integer must be a valid pointer.
@@ -300,32 +534,49 @@ int parse_flag(intmax_t *result, WORD_LIST **list, const char *opts, const intma
     })
 
 /**
- * @param arg should be in uppercase
- * @return -1 on failure and print err msg to stderr, otherwise errno.
+ * @return index of name in table generated from lookup_tables.def, -1 if not found.
+ *
+ * name does not need to be NUL-terminated and the comparison is case-insensitive.
  */
-int parse_errno(const char *arg, size_t i, const char *fname)
+ssize_t lookup(const struct lookup_table *table, const char *name, size_t len)
 {
-    const char *self_name = "parse_errno";
+    uint32_t hash = lookup_hash(name, len);
+    uint16_t disp = table->disps[lookup_reduce(hash, table->ndisps)];
+    uint32_t slot = lookup_slot(hash, disp, table->nslots);
 
-    if (arg[0] != 'E') {
-        warnx("%s: %s: the %zu arg isn't errno", fname, self_name, i);
+    const char *entry = table->names + table->offsets[slot];
+    if (len == 0 || strncasecmp(entry, name, len) != 0 || entry[len] != '\0')
         return -1;
-    }
-    ++arg;
-
-    typedef int (*cmp_t)(const void*, const void*);
+    return slot;
+}
+/**
+ * LOOKUP_N looks up name of len in table lookup_##table and stores its value in *value.
+ *
+ * @return 0 on success, -1 if not found.
+ */
+#define LOOKUP_N(table, name, len, value)                         \
+    ({                                                            \
+        ssize_t lookup_i = lookup(&lookup_ ## table, (name), (len)); \
+        if (lookup_i != -1)                                       \
+            *(value) = lookup_ ## table ## _values[lookup_i];     \
+        lookup_i == -1 ? -1 : 0;                                  \
+    })
+#define LOOKUP(table, name, value) LOOKUP_N(table, (name), strlen(name), (value))
 
-    const size_t size = sizeof(const char*);
-    const size_t nmemb = sizeof(errno_strs) / size;
-    cmp_t cmp = (cmp_t) strcmp;
+/**
+ * @return -1 on failure and print err msg to stderr, otherwise errno.
+ */
+int parse_errno(const char *arg, size_t i, const char *fname)
+{
+    const char *self_name = "parse_errno";
 
-    const char* const *result = (const char* const *) bsearch(arg, errno_strs, nmemb, size, cmp);
-    if (result == NULL) {
+    int errno_v;
+    if ((arg[0] != 'E' && arg[0] != 'e') || LOOKUP(errnos, arg + 1, &errno_v) == -1) {
         warnx("%s: %s: the %zu arg isn't errno", fname, self_name, i);
         return -1;
     }
 
-    return errnos[result - errno_strs];
+    return errno_v;
 }
 
 #endif